@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Areas of effect rasterized into offsets from the acting entity. The shape of an area only
+ * depends upon the ability, its direction, and its range, so each shape is made once and reused
+ * every time the ability is used.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+class AreaStencil {
+    public:
+        // An offset in {y, x}.
+        using Offset = std::pair<int64_t, int64_t>;
+
+        // All tiles within a Manhattan distance of range.
+        static AreaStencil diamond(int64_t range);
+
+        // A cone from first_distance to last_distance along direction. The width at each distance
+        // grows by width_slope and the sides extend along side_direction.
+        static AreaStencil cone(int64_t first_distance, int64_t last_distance, double width_base,
+            double width_slope, const std::array<double, 2>& direction, const std::array<double, 2>& side_direction);
+
+        // The offsets of the area, sorted and without duplicates.
+        const std::vector<Offset>& offsets() const;
+
+        // The largest Manhattan distance of any offset.
+        size_t reach() const;
+
+        bool contains(int64_t y_offset, int64_t x_offset) const;
+
+        // The tiles covered by the area around y, x. Tiles with negative coordinates are skipped.
+        std::vector<std::tuple<size_t, size_t>> tiles(size_t y, size_t x) const;
+
+    private:
+        std::vector<Offset> sorted_offsets;
+        size_t max_reach = 0;
+
+        explicit AreaStencil(std::vector<Offset> offsets);
+};
+
+// Stencils cached by their owner (such as an ability), a variant (such as a direction), and a
+// range. Owners must outlive the cache entries.
+class AreaStencils {
+    public:
+        // The stencil for the key, made with make() the first time that the key is used.
+        template<typename Make>
+        const AreaStencil& get(const void* owner, const std::string& variant, int64_t range, Make&& make) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto key = std::make_tuple(owner, variant, range);
+            auto found = stencils.find(key);
+            if (found == stencils.end()) {
+                found = stencils.emplace(std::move(key), make()).first;
+            }
+            // Map nodes do not move, so the reference stays valid after the lock is released.
+            return found->second;
+        }
+
+    private:
+        std::map<std::tuple<const void*, std::string, int64_t>, AreaStencil> stencils;
+        std::mutex mutex;
+};
@@ -10,8 +10,10 @@
 
 #pragma once
 
+#include <array>
 #include <functional>
 #include <map>
+#include <optional>
 #include <set>
 #include <string>
 #include <tuple>
@@ -25,6 +27,7 @@ namespace Behavior {
 }
 
 #include "command_handler.hpp"
+#include "trait_set.hpp"
 #include "entity.hpp"
 #include "world_state.hpp"
 
@@ -85,9 +88,75 @@ namespace Behavior {
             {AbilityRange::far, "far"},
         })
 
+    // A tile offset in {y, x}.
+    struct TileOffset {
+        int y = 0;
+        int x = 0;
+    };
+
+    enum class MovementType {
+        none,
+        // Move by a fixed offset.
+        fixed,
+        // Move a random distance along a random axis.
+        random,
+        // Move relative to a target.
+        minimize_distance,
+        maximize_distance,
+        maintain_distance
+    };
+
+    // Damage dealt by an attack as coefficients of the attacker's attributes.
+    struct DamageEffect {
+        double base = 0;
+        double strength = 0;
+        double domain = 0;
+        double aura = 0;
+        double reflexes = 0;
+    };
+
+    // The shape of an area of effect. Radius areas only use range_max.
+    struct AreaEffect {
+        double range_min = 0;
+        double range_max = 0;
+        double width_base = 0;
+        double width_slope = 0;
+        // Added to the range for each point of the actor's vitality.
+        double vitality_mod = 0;
+    };
+
+    // The effects of one of an ability's argument options, such as a direction.
+    struct OptionEffect {
+        // The tile targeted by a single target ability.
+        std::optional<TileOffset> distance;
+        // The direction of a cone and of its sides, in {y, x} components.
+        std::array<double, 2> direction{};
+        std::array<double, 2> side_direction{};
+    };
+
+    // An ability's effects, decoded from json when the ability is loaded.
+    struct Effects {
+        MovementType movement = MovementType::none;
+        TileOffset distance;
+        int random_min = 0;
+        int random_max = 0;
+
+        DamageEffect damage;
+        std::optional<AreaEffect> area;
+        // The range of a named target.
+        size_t range = 0;
+        // Effects for each argument option.
+        std::map<std::string, OptionEffect> options;
+
+        // Utility effects
+        std::vector<std::string> information;
+        std::optional<std::string> equip;
+    };
+
     struct Ability {
         // Ability name
         std::string name;
+        Opcode opcode;
         // TODO Description?
 
         // Ability type and area of effect.
@@ -97,12 +166,19 @@ namespace Behavior {
         size_t stamina;
         std::vector<std::string> arguments;
         std::vector<std::string> default_args;
+        // The choices of an "or" argument list, and whether a target may be named instead.
+        std::vector<std::string> argument_options;
+        bool target_argument = false;
         // Each effect may change multiple variables or require multiple variables to calculate.
-        std::map<std::string, nlohmann::json> effects;
+        Effects effects;
         // Abilities that must be known prior to this one.
         std::map<std::string, size_t> prereqs;
         // Traits that must be possessed to use this ability.
         std::vector<std::string> constraints;
+        // The constraints as a trait mask. If any_constraint is true then only one of the traits
+        // is required (the constraints began with "or").
+        TraitSet constraint_traits;
+        bool any_constraint = false;
         // Flavor text when this ability is used.
         std::string flavor;
         std::string fail_flavor;
@@ -112,19 +188,34 @@ namespace Behavior {
         // TODO FIXME Should these just be objects instead of lambda functions? The lambda functions
         // can't be queried for information, which is annoying.
         // Make a movement type of function.
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeUtilityFunction(Entity& entity) const;
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeMoveFunction(Entity& entity) const;
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeConditionalMoveFunction(Entity& entity) const;
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeLinearMoveFunction(Entity& entity) const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeUtilityFunction() const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeMoveFunction() const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeConditionalMoveFunction() const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeLinearMoveFunction() const;
 
         // Make an attack type of function.
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeAttackFunction(Entity& entity) const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeAttackFunction() const;
 
         // Make a function for this ability
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeFunction(Entity& entity) const;
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> makeFunction() const;
 
-        // Construct from a json object.
+        // The function for this ability. It is made once when the ability set is loaded and is
+        // shared by every entity with the ability, which is passed in when the ability is used.
+        // The function refers back to this ability, so abilities are not copied.
+        std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> function;
+
+        // Use this ability.
+        void execute(Entity& actor, WorldState& ws, const std::vector<std::string>& arguments) const;
+
+        // True if an entity with the given traits satisfies the ability's constraints.
+        bool meetsConstraints(const TraitSet& traits) const;
+
+        // Construct from a json object. Throws std::runtime_error if the effects are malformed.
         Ability(const std::string& name, nlohmann::json& ability_json);
+        Ability(const Ability&) = delete;
+        Ability(Ability&&) = default;
+        Ability& operator=(const Ability&) = delete;
+        Ability& operator=(Ability&&) = default;
     };
 
     struct AbilitySet {
@@ -145,15 +236,58 @@ namespace Behavior {
         // Update abilities from this set that are available to an entity. Return new abilities.
         std::vector<std::string> updateAvailable(Entity& entity) const;
 
-        // Get the ability function for the given entity.
-        std::function<void(WorldState&, const std::vector<std::string>&)> makeFunction(const std::string& ability, Entity& entity) const;
-
         // TODO A check if an entity can use the behavior set.
     };
 
     // Get all of the available behavior sets.
     const std::vector<AbilitySet>& getAbilities();
 
+    enum class Comparison {
+        less,
+        greater,
+        less_equal,
+        greater_equal,
+        not_equal,
+        equal
+    };
+
+    enum class ConditionType {
+        // "hp < 10%"
+        hp,
+        // "distance:player < 2"
+        distance,
+        // "sense player"
+        sense,
+        // "else"
+        otherwise
+    };
+
+    // A rule condition, parsed from its text when the behavior set is loaded.
+    struct Condition {
+        ConditionType type = ConditionType::otherwise;
+        Comparison comparison = Comparison::less;
+        // Fraction of maximum health for hp conditions.
+        double threshold = 0;
+        // Distance for distance conditions.
+        size_t range = 0;
+        // Target of distance and sense conditions. It is first searched for as a trait, with the
+        // query interned when the rule is loaded, and then as a name.
+        TraitQuery target_traits;
+        std::string target_name;
+    };
+
+    // A command taken when a rule's condition is met, split into its parts when loaded.
+    struct Action {
+        Opcode command;
+        std::vector<std::string> arguments;
+        size_t repetitions = 1;
+    };
+
+    struct Rule {
+        Condition condition;
+        std::vector<Action> actions;
+    };
+
     // Conditions and abilities that define the behavior of an entity.
     struct BehaviorSet {
         // Name of the behavior set.
@@ -163,11 +297,16 @@ namespace Behavior {
         std::string description;
 
         // Conditions and actions that make up this behavior set, ordered by precedence.
-        std::vector<std::vector<std::string>> rules;
+        std::vector<Rule> rules;
+
+        // Construct from a json object. Throws std::runtime_error if a rule cannot be parsed. Actions
+        // that are not known commands are skipped with a warning. The abilities must be loaded first.
+        BehaviorSet(const std::string& name, nlohmann::json& behavior_json);
 
         // Go through the behavior set of the given entity and follow its rules to take appropriate
-        // actions.
-        void executeBehavior(Entity&, WorldState&, CommandHandler&) const;
+        // actions. This only reads the world state, so it may run for many entities at once as
+        // long as each thread has its own buffer.
+        void executeBehavior(const Entity&, WorldState&, CommandBuffer&) const;
     };
 
     const std::map<std::string, BehaviorSet>& getBehaviors();
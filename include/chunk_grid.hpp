@@ -0,0 +1,83 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Worlds are divided into square chunks of tiles. Per-tile storage is allocated a chunk at a time
+ * when a chunk is first written, so memory scales with the area in use rather than with the size
+ * of the map.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Width and height of a chunk, in tiles.
+constexpr size_t chunk_size = 32;
+constexpr size_t chunk_area = chunk_size * chunk_size;
+
+template<typename Chunk>
+class ChunkGrid {
+    public:
+        ChunkGrid(size_t field_height, size_t field_width) :
+            chunks_wide((field_width + chunk_size - 1) / chunk_size),
+            chunks_high((field_height + chunk_size - 1) / chunk_size),
+            chunks(chunks_wide * chunks_high) {
+        }
+
+        // The chunk that contains the tile, in row major order.
+        size_t chunkOf(size_t y, size_t x) const {
+            return (y / chunk_size) * chunks_wide + x / chunk_size;
+        }
+
+        // The position of a tile within its chunk, in row major order.
+        static size_t offsetOf(size_t y, size_t x) {
+            return (y % chunk_size) * chunk_size + x % chunk_size;
+        }
+
+        // The chunk, or nullptr if it has not been allocated.
+        Chunk* find(size_t chunk) {
+            return chunks[chunk].get();
+        }
+
+        const Chunk* find(size_t chunk) const {
+            return chunks[chunk].get();
+        }
+
+        // The chunk, allocating it if necessary.
+        Chunk& obtain(size_t chunk) {
+            if (not chunks[chunk]) {
+                chunks[chunk] = std::make_unique<Chunk>();
+                allocated.push_back(chunk);
+            }
+            return *chunks[chunk];
+        }
+
+        // Free a chunk's storage.
+        void release(size_t chunk) {
+            if (chunks[chunk]) {
+                chunks[chunk].reset();
+                allocated.erase(std::find(allocated.begin(), allocated.end(), chunk));
+            }
+        }
+
+        // The chunks that are currently allocated, in allocation order.
+        const std::vector<size_t>& allocatedChunks() const {
+            return allocated;
+        }
+
+        size_t chunksWide() const {
+            return chunks_wide;
+        }
+
+        size_t chunksHigh() const {
+            return chunks_high;
+        }
+
+    private:
+        size_t chunks_wide;
+        size_t chunks_high;
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        std::vector<size_t> allocated;
+};
@@ -8,43 +8,194 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
+class CommandBuffer;
 class CommandHandler;
 
+#include "command_table.hpp"
 #include "entity.hpp"
+#include "entity_store.hpp"
 #include "world_state.hpp"
 
+// A command string split into its parts. The parts are views into the command string.
+struct ParsedCommand {
+    // The repetition count from the front of the string, such as the 10 in "10 north". Commands
+    // without a count are performed once.
+    size_t repetitions = 1;
+    std::string_view command;
+    std::vector<std::string_view> arguments;
+};
+
+// Split a command string on spaces without copying it.
+ParsedCommand parseCommand(std::string_view text);
+
+// Commands queued by one worker while entities decide on their actions in parallel. Buffers are
+// merged into a CommandHandler in entity ID order so that the result does not depend upon how the
+// entities were divided among the workers.
+class CommandBuffer {
+    private:
+        friend class CommandHandler;
+
+        struct Entry {
+            size_t entity_id;
+            EntityHandle entity;
+            Opcode command;
+            const std::vector<std::string>* arguments;
+            size_t repetitions;
+        };
+        std::vector<Entry> entries;
+
+    public:
+        // A command for a referenced entity that has already been split into its parts. The
+        // arguments are not copied, so they must outlive the executing of the command, as the
+        // arguments of loaded behavior rules do.
+        void enqueueEntityRefCommand(const Entity& entity, EntityHandle handle, Opcode command,
+            const std::vector<std::string>& arguments, size_t repetitions);
+};
+
 class CommandHandler {
+    public:
+        class Producer;
+
     private:
+        // A command submitted by a producer, waiting for the simulation thread to take it. Exactly
+        // one of entity_name, traits, or entity is the target. Submissions are reused by the
+        // producer that owns them, so their strings and vectors keep their capacity.
+        struct Submission {
+            Submission* next = nullptr;
+            Producer* owner = nullptr;
+            std::string entity_name;
+            std::vector<std::string> traits;
+            EntityHandle entity;
+            Opcode command = 0;
+            std::vector<std::string> arguments;
+            size_t repetitions = 1;
+        };
+
+        // Push a submission onto the front of a linked list with a compare and swap. The list may
+        // be pushed to from any number of threads while one other thread takes the whole list.
+        static void push(std::atomic<Submission*>& list, Submission* submission);
+
+        // Submitted commands, newest first. The simulation thread takes the whole list at once and
+        // reverses it to recover the submission order.
+        std::atomic<Submission*> submissions{nullptr};
+        // Move all submitted commands into the queues below.
+        void takeSubmissions();
+        // Submissions taken this tick. Queued commands refer to their targets and arguments, so
+        // they are only given back to their producers once the commands have executed.
+        std::vector<Submission*> taken;
+
+    public:
+        // A source of commands on one thread, such as an input thread or a network session.
+        // Each producer recycles its own submissions, so queueing a command does not allocate
+        // once the producer has warmed up. A producer may queue commands at any time, even during
+        // a tick. Commands are taken when executeCommands next starts.
+        // Command names may be abbreviated to any unique prefix. Commands that no ability has been
+        // loaded for are dropped, since no entity can take them.
+        class Producer {
+            public:
+                explicit Producer(CommandHandler& handler);
+                Producer(const Producer&) = delete;
+                Producer& operator=(const Producer&) = delete;
+
+                // A command for an entity by its name
+                void enqueueNamedEntityCommand(const std::string& entity, const std::string& command);
+
+                // A command for a referenced entity
+                void enqueueEntityRefCommand(EntityHandle entity, const std::string& command);
+
+                // A command for a referenced entity that has already been split into its parts
+                void enqueueEntityRefCommand(EntityHandle entity, Opcode command,
+                    std::vector<std::string>&& arguments, size_t repetitions);
+
+                // A command for all entities with the given trait
+                void enqueueTraitCommand(const std::vector<std::string>& traits, const std::string& command);
+
+            private:
+                friend class CommandHandler;
+
+                CommandHandler& handler;
+                // Storage for every submission of this producer. A deque so that submissions do
+                // not move as more are added.
+                std::deque<Submission> storage;
+                // Submissions that may be reused. Only used by the producer's thread.
+                std::vector<Submission*> available;
+                // Submissions given back by the simulation thread after their commands executed.
+                std::atomic<Submission*> returned{nullptr};
+
+                // A submission that is not in use, with its targets cleared.
+                Submission& obtain();
+                // Parse a command into a submission. Returns nullptr if the command is not valid.
+                Submission* parse(const std::string& command);
+        };
+
+    private:
+        // Producers are kept for the life of the handler, so that their submissions can always be
+        // given back to them.
+        std::deque<Producer> producers;
+        std::mutex producers_mutex;
+
         // The queue of commands
-        // Commands of type <enity ID, command string, command arguments>
-        // TODO Eventually, this should become sorted by the reflexes attribute.
-        std::vector<std::tuple<size_t, std::string, std::vector<std::string>>> entity_commands;
-        // Commands stored for entity names or traits.
-        std::vector<std::tuple<std::string, std::string, std::vector<std::string>>> named_entity_commands;
-        std::vector<std::tuple<std::vector<std::string>, std::string, std::vector<std::string>>> trait_commands;
+        // Commands of type <enity handle, command opcode, command arguments, repetitions>
+        // These are executed in initiative order rather than the order that they were queued.
+        // Repeated commands are a single entry that is performed once per turn of the entity.
+        std::vector<std::tuple<EntityHandle, Opcode, const std::vector<std::string>*, size_t>> entity_commands;
+
+        // The next command of an entity in the round. Entities act at intervals set by their
+        // reflexes, so a faster entity may take several actions before a slower one takes its
+        // second. Ties go to the faster entity, and then to the entity whose commands were queued
+        // first.
+        struct Turn {
+            uint64_t initiative;
+            uint64_t delay;
+            // The entity's position in the order of first commands.
+            size_t order;
+            // Indices into entity_commands of the next and the last command of the entity.
+            size_t command;
+            size_t last;
+            // Repetitions of the next command that are still to be performed.
+            size_t remaining;
+        };
+        // Time units in a round. An entity with no reflexes acts once per round.
+        static constexpr uint64_t round_length = 1 << 20;
+        static uint64_t initiativeDelay(const WorldState& ws, EntityHandle handle);
+
+        // Scheduling storage, kept between rounds to avoid reallocation.
+        std::vector<Turn> turns;
+        // The index of the entity command that follows each entity command from the same entity.
+        std::vector<size_t> following;
+        // The turn of each entity slot while the turns are being built.
+        std::vector<size_t> slot_turns;
+        // Commands stored for entity names or traits. The names and traits belong to submissions.
+        std::vector<std::tuple<const std::string*, Opcode, const std::vector<std::string>*, size_t>> named_entity_commands;
+        std::vector<std::tuple<const std::vector<std::string>*, Opcode, const std::vector<std::string>*, size_t>> trait_commands;
 
     public:
-        CommandHandler();
+        CommandHandler() = default;
+        CommandHandler(const CommandHandler&) = delete;
+        CommandHandler& operator=(const CommandHandler&) = delete;
 
         // TODO FIXME Add argument lists for all of the commands
         // TODO FIXME Events, such as recovery, that occur every tick.
 
-        // A command for an entity by its name
-        void enqueueNamedEntityCommand(const std::string& entity, const std::string& command);
-
-        // A command for a referenced entity
-        void enqueueEntityRefCommand(std::list<Entity>::iterator entity_i, const std::string& command);
-
-        // A command for all entities with the given trait
-        void enqueueTraitCommand(const std::vector<std::string>& traits, const std::string& command);
+        // Make a new producer of commands for a thread. The producer lives as long as the handler.
+        // This is safe to call from any thread.
+        Producer& addProducer();
 
-        // A command for the given entity.
-        void enqueueEntityCommand(const Entity& entity, const std::string& command);
+        // Move the commands from the buffers into the queue, ordered by entity ID. Commands for the
+        // same entity keep the order in which they were queued. This is called by the simulation
+        // thread between ticks.
+        void enqueueBuffers(std::vector<CommandBuffer>& buffers);
 
-        // Execute all enqueued commands. Entity commands will always occur before trait commands.
+        // Execute all enqueued commands, interleaving the commands of different entities by the
+        // reflexes of the entities. Only the simulation thread may call this.
         void executeCommands(WorldState& ws);
 };
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Interned command names. Every command name is assigned a small integer opcode when abilities are
+ * loaded, so queued commands carry an opcode instead of a string and each entity finds the ability
+ * for a command with an array index.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Behavior {
+    struct Ability;
+}
+
+using Opcode = uint32_t;
+
+namespace Commands {
+    // Get the opcode for a command name, assigning a new one if the name has not been seen before.
+    // Only the names of commands that entities can perform should be interned, since every name
+    // makes abbreviations of the names that share its prefix longer. Interning is not thread safe,
+    // so it should happen while loading abilities.
+    Opcode intern(const std::string& command);
+
+    // Get the opcode for a command name if it has been interned. Returns false if it has not been
+    // seen, in which case no entity can perform it.
+    bool find(std::string_view command, Opcode& opcode);
+
+    // Get the opcode for a command name or for an abbreviation of one. An abbreviation is any
+    // prefix that is shared by no other command name. Returns false if the name is unknown or the
+    // abbreviation is ambiguous. This takes time proportional to the length of the name.
+    bool resolve(std::string_view command, Opcode& opcode);
+
+    // The name of an interned command.
+    const std::string& name(Opcode opcode);
+}
+
+// The abilities of an entity, indexed by opcode.
+class CommandTable {
+    private:
+        std::vector<const Behavior::Ability*> abilities;
+        size_t count = 0;
+
+    public:
+        // Add an ability for a command. An existing ability for the command is kept.
+        void insert(Opcode opcode, const Behavior::Ability* ability);
+
+        // The ability for a command, or nullptr if the entity cannot perform it.
+        const Behavior::Ability* find(Opcode opcode) const {
+            return opcode < abilities.size() ? abilities[opcode] : nullptr;
+        }
+        const Behavior::Ability* find(const std::string& command) const;
+
+        bool contains(Opcode opcode) const {
+            return nullptr != find(opcode);
+        }
+
+        bool empty() const;
+
+        // The names of the commands that the entity can perform, in sorted order.
+        std::vector<std::string> names() const;
+};
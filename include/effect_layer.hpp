@@ -0,0 +1,74 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * A dense layer of visual effects, one per tile. Each mark is stamped with the current generation,
+ * so clearing the layer only advances the generation instead of touching every tile.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "chunk_grid.hpp"
+
+enum class TileEffect : uint8_t {
+    none,
+    red,
+    cyan,
+};
+
+// The color name of an effect, as understood by the user interface.
+const char* effectColor(TileEffect effect);
+
+class EffectLayer {
+    public:
+        EffectLayer(size_t field_height, size_t field_width);
+
+        // Mark a tile with an effect. The first effect marked on a tile since the last clear is
+        // kept. Out of bounds tiles are ignored.
+        void mark(size_t y, size_t x, TileEffect effect);
+
+        // The effect on a tile, or TileEffect::none.
+        TileEffect at(size_t y, size_t x) const;
+
+        // Remove all effects.
+        void clear();
+
+        // Free the storage of a chunk of tiles, removing its effects.
+        void releaseChunk(size_t chunk);
+
+        // Call visit(y, x, effect) for every marked tile.
+        template<typename Visitor>
+        void forEachMarked(Visitor&& visit) const {
+            for (size_t tile : marked) {
+                size_t y = tile / field_width;
+                size_t x = tile % field_width;
+                const Chunk* chunk = tiles.find(tiles.chunkOf(y, x));
+                // The tile's chunk may have been released since it was marked.
+                if (nullptr != chunk and (*chunk)[tiles.offsetOf(y, x)].generation == generation) {
+                    visit(y, x, (*chunk)[tiles.offsetOf(y, x)].effect);
+                }
+            }
+        }
+
+        size_t height() const;
+        size_t width() const;
+
+    private:
+        struct Tile {
+            uint32_t generation = 0;
+            TileEffect effect = TileEffect::none;
+        };
+
+        using Chunk = std::array<Tile, chunk_area>;
+
+        size_t field_height;
+        size_t field_width;
+        // Tiles, allocated a chunk at a time. A tile is only marked if its generation is current.
+        ChunkGrid<Chunk> tiles;
+        uint32_t generation = 1;
+        // Row major indices of the tiles marked in this generation.
+        std::vector<size_t> marked;
+};
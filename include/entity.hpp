@@ -16,6 +16,8 @@
 
 // Need to forward declare Entity here since the class is used inside of the world state.
 struct Entity;
+#include "command_table.hpp"
+#include "trait_set.hpp"
 #include "world_state.hpp"
 #include "behavior.hpp"
 
@@ -39,7 +41,10 @@ struct Stats {
     size_t class2_level;
     size_t class3_level;
 
-    void ticHealthManaStamina(size_t tick_num);
+    // Regeneration per tick (derived values). Fractional amounts accumulate over ticks.
+    double healthRegen() const;
+    double manaRegen() const;
+    double staminaRegen() const;
 
     // The maximum mana of this entity (derived from aura and domain)
     size_t maxMana() const;
@@ -68,7 +73,7 @@ struct Entity {
     std::string name;
 
     // Traits of this entity
-    std::set<std::string> traits;
+    TraitSet traits;
 
     // Equipment slots are determined by traits.
     std::set<std::string> possible_slots;
@@ -99,13 +104,12 @@ struct Entity {
     std::string getObjectType() const;
 
     // The command handling functions of this entity.
-    // The second argument, the argument list to the command, is documented in command_args.
+    // The third argument, the argument list to the command, is documented in command_args.
     // These keep command handling tied to the entity level, while the commands themselves will be
     // enqueued in the command queue.
-    // Notice that these will most likely be lambda functions with references to the entity that
-    // they effect.
-    std::map<std::string, std::function<void(WorldState&, const std::vector<std::string>&)>> command_handlers = {};
-    std::map<std::string, Behavior::Ability> command_details = {};
+    // The abilities are shared by every entity that has them and live in the loaded ability sets.
+    // The acting entity is passed in when an ability is used.
+    CommandTable command_handlers;
 
     // Master of a command. Increases effectiveness and possibly unlocks new commands and behaviors.
     std::map<std::string, double> command_mastery = {};
@@ -116,12 +120,18 @@ struct Entity {
 
     // Constructors
     Entity(size_t y, size_t x, const std::string& name, const std::set<std::string> traits);
+    // Recreate an entity that was assigned entity_id earlier, such as one that is being restored
+    // from storage. No new ID is used up.
+    Entity(size_t entity_id, size_t y, size_t x, const std::string& name, const std::set<std::string> traits);
 
     // Don't accidentally copy entities, only allow copying via destructive r-value reference.
     Entity(const Entity&) = delete;
-    Entity(Entity&&);
+    Entity(Entity&&) noexcept;
+    Entity& operator=(const Entity&) = delete;
+    Entity& operator=(Entity&&) noexcept;
 
-    std::string getDescription() const;
+    // A description of the entity in the world with the given random seed.
+    std::string getDescription(uint64_t world_seed) const;
 
     // Equality operator. Based upon the entity_id value.
     bool operator==(const Entity&) const;
@@ -0,0 +1,23 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Conversion of entities to and from json, used to move entities out of memory while the part of
+ * the world that they are in is inactive.
+ */
+
+#pragma once
+
+#include <nlohmann/json.hpp>
+
+#include "entity.hpp"
+
+using json = nlohmann::json;
+
+// Serialize the state of an entity that cannot be rebuilt from lore: its identity, location,
+// traits, stats, behavior, equipment, and mastery.
+json serializeEntity(const Entity& entity);
+
+// Rebuild an entity from serializeEntity's output. Lore derived state, such as the display
+// character and equipment slots, is recreated and the entity's abilities are granted again. The
+// entity keeps its original entity ID.
+Entity deserializeEntity(const json& record);
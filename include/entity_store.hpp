@@ -0,0 +1,147 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Contiguous storage for entities. Entities live in a dense array and are referred to with
+ * generational handles, so a handle to an entity that has been removed will simply fail to resolve
+ * instead of pointing at whatever entity now occupies its storage.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+struct Entity;
+
+struct EntityHandle {
+    static constexpr uint32_t null_slot = std::numeric_limits<uint32_t>::max();
+
+    uint32_t slot = null_slot;
+    uint32_t generation = 0;
+
+    // True if this handle was ever assigned to an entity. Use EntityStore::contains to check if the
+    // entity still exists.
+    explicit operator bool() const {
+        return null_slot != slot;
+    }
+
+    bool operator==(const EntityHandle&) const = default;
+};
+
+class EntityStore {
+    private:
+        static constexpr uint32_t retired_slot = std::numeric_limits<uint32_t>::max();
+
+        struct Slot {
+            uint32_t dense_index;
+            uint32_t generation;
+        };
+
+        // The entities, packed together.
+        std::vector<Entity> dense;
+        // The slot of each entity in the dense array, or retired_slot if the entity was retired.
+        std::vector<uint32_t> dense_slots;
+        // Indirection from handles to the dense array.
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+        // Dense indices of retired entities that are waiting for compact()
+        std::vector<uint32_t> retired;
+        // Lookup from entity IDs to slots.
+        std::unordered_map<size_t, uint32_t> id_to_slot;
+
+    public:
+        // Iteration visits every live entity. Retired entities are skipped.
+        template<typename StoreT, typename EntityT>
+        class BasicIterator {
+            private:
+                StoreT* store = nullptr;
+                size_t index = 0;
+
+                void skipRetired() {
+                    while (index < store->dense_slots.size() and retired_slot == store->dense_slots[index]) {
+                        ++index;
+                    }
+                }
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = Entity;
+                using difference_type = std::ptrdiff_t;
+                using pointer = EntityT*;
+                using reference = EntityT&;
+
+                BasicIterator() = default;
+                BasicIterator(StoreT* store, size_t index) : store(store), index(index) {
+                    skipRetired();
+                }
+
+                reference operator*() const {
+                    return store->dense[index];
+                }
+                pointer operator->() const {
+                    return &store->dense[index];
+                }
+                BasicIterator& operator++() {
+                    ++index;
+                    skipRetired();
+                    return *this;
+                }
+                BasicIterator operator++(int) {
+                    BasicIterator previous = *this;
+                    ++(*this);
+                    return previous;
+                }
+                bool operator==(const BasicIterator& other) const {
+                    return index == other.index;
+                }
+        };
+        using iterator = BasicIterator<EntityStore, Entity>;
+        using const_iterator = BasicIterator<const EntityStore, const Entity>;
+
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+
+        // Add an entity and return its handle. Like std::vector::push_back this may invalidate
+        // references to other entities.
+        EntityHandle insert(Entity&& entity);
+
+        // Remove an entity immediately. This invalidates references to other entities.
+        void erase(EntityHandle handle);
+
+        // Remove an entity without moving any other entities. The handle and entity ID stop
+        // resolving immediately, but the storage is only reclaimed by compact(), so references
+        // held by running commands remain valid until then.
+        void retire(EntityHandle handle);
+
+        // Reclaim the storage of retired entities. Invalidates references to entities.
+        void compact();
+
+        // True if the handle refers to a live entity.
+        bool contains(EntityHandle handle) const;
+
+        // Get the entity for a handle, or nullptr if it no longer exists.
+        Entity* get(EntityHandle handle);
+        const Entity* get(EntityHandle handle) const;
+
+        // Get the entity for a handle. Throws std::out_of_range if it no longer exists.
+        Entity& at(EntityHandle handle);
+        const Entity& at(EntityHandle handle) const;
+
+        // Find the handle of the entity with the given ID, or a null handle.
+        EntityHandle find(size_t entity_id) const;
+
+        // The handle of an entity in this store.
+        EntityHandle handleOf(const Entity& entity) const;
+
+        // The number of live entities.
+        size_t size() const;
+        bool empty() const;
+
+        // All entities in storage order. Only every entry is live directly after compact().
+        std::span<Entity> denseEntities();
+};
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Distances from a set of goal tiles, found with one breadth first search that is shared by every
+ * entity heading towards or away from those goals. Entities move closer to a goal by stepping to
+ * a neighboring tile with a smaller distance, and farther by stepping to one with a larger
+ * distance. Distances are stamped with a generation, like EffectLayer, so recomputing a field does
+ * not need to clear it first.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "chunk_grid.hpp"
+
+class FlowField {
+    public:
+        static constexpr uint16_t unreachable = std::numeric_limits<uint16_t>::max();
+
+        FlowField(size_t field_height, size_t field_width);
+
+        // Find the distance of every tile within max_distance steps of a goal, moving in the four
+        // cardinal directions through tiles where passable(y, x) is true. Goal tiles themselves
+        // do not need to be passable.
+        template<typename Passable>
+        void compute(const std::vector<std::pair<size_t, size_t>>& goals, uint16_t max_distance, Passable&& passable) {
+            advanceGeneration();
+            frontier.clear();
+            for (auto [y, x] : goals) {
+                if (y < field_height and x < field_width and set(y, x, 0)) {
+                    frontier.push_back(y * field_width + x);
+                }
+            }
+            // The frontier holds tiles in order of distance, so it doubles as the queue.
+            for (size_t next = 0; next < frontier.size(); ++next) {
+                size_t y = frontier[next] / field_width;
+                size_t x = frontier[next] % field_width;
+                uint16_t step = distance(y, x) + 1;
+                if (step > max_distance) {
+                    continue;
+                }
+                auto visit = [&](size_t ny, size_t nx) {
+                    if (passable(ny, nx) and set(ny, nx, step)) {
+                        frontier.push_back(ny * field_width + nx);
+                    }
+                };
+                // Unsigned wrap around at the edges is caught by the bounds check in set.
+                visit(y - 1, x);
+                visit(y + 1, x);
+                visit(y, x - 1);
+                visit(y, x + 1);
+            }
+        }
+
+        // Steps from the tile to the nearest goal, or unreachable if it is farther than the
+        // max_distance of the last computation or cannot be reached at all.
+        uint16_t distance(size_t y, size_t x) const;
+
+        // Free the storage of a chunk of tiles. Its distances are lost until the next computation.
+        void releaseChunk(size_t chunk);
+
+    private:
+        struct Tile {
+            uint32_t generation = 0;
+            uint16_t distance = unreachable;
+        };
+
+        using Chunk = std::array<Tile, chunk_area>;
+
+        size_t field_height;
+        size_t field_width;
+        ChunkGrid<Chunk> tiles;
+        uint32_t generation = 0;
+        // Row major indices of reached tiles, in the order they were reached.
+        std::vector<size_t> frontier;
+
+        // Set the distance of a tile if it has not been reached yet in this generation. Returns
+        // true if the tile was newly reached.
+        bool set(size_t y, size_t x, uint16_t distance);
+
+        void advanceGeneration();
+};
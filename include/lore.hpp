@@ -8,6 +8,7 @@
 
 #include <nlohmann/json.hpp>
 
+#include <cstdint>
 #include <optional>
 #include <set>
 #include <string>
@@ -17,7 +18,9 @@
 using json = nlohmann::json;
 
 namespace OlymposLore {
-    std::string getDescription(const Entity& entity);
+    // The description is chosen with the world's random seed, so an entity is always described
+    // the same way within a world.
+    std::string getDescription(const Entity& entity, uint64_t world_seed);
     std::optional<Stats> getStats(const Entity& entity);
     std::set<std::string> getNamedEntry(const Entity& entity, const std::string& field);
     std::set<std::string> getLoreField(const std::string lore_name, const std::string& field);
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * An index from case folded entity names to entities. Name searches are case insensitive
+ * substring (or regex) searches, so rather than checking every entity this checks each distinct
+ * name once and remembers which names matched each pattern.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <regex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "entity_store.hpp"
+
+class NameIndex {
+    public:
+        void insert(EntityHandle entity, const std::string& name);
+        void erase(EntityHandle entity, const std::string& name);
+
+        // Handles of all entities whose name contains the pattern, ignoring case. Patterns that
+        // contain regex special characters are treated as regular expressions, matching the
+        // behavior of std::regex_search with icase. The handles are sorted by slot.
+        // Searches may run concurrently with each other, but not with insert or erase.
+        std::vector<EntityHandle> find(const std::string& pattern);
+
+        // True if find could return an entity with the given name. Regex patterns are assumed to
+        // match anything.
+        static bool mayMatch(const std::string& pattern, const std::string& name);
+
+    private:
+        struct CompiledPattern {
+            // Literal patterns are matched with a substring search on the folded name.
+            bool literal = true;
+            std::string folded;
+            std::regex regex;
+            // The folded names that matched, valid while version matches names_version.
+            std::vector<std::string> matching_names;
+            uint64_t version = 0;
+        };
+
+        // Entities, by case folded name.
+        std::unordered_map<std::string, std::vector<EntityHandle>> names;
+        // The position of each entity in its name's list, by slot, so that erasing does not search.
+        std::vector<uint32_t> positions;
+        // Incremented whenever a distinct name is added or removed.
+        uint64_t names_version = 1;
+
+        // Compiled patterns and their matches. Cleared if it grows too large.
+        std::unordered_map<std::string, CompiledPattern> pattern_cache;
+        static constexpr size_t max_cached_patterns = 256;
+        // Guards pattern_cache, which is updated by searches.
+        std::shared_mutex cache_mutex;
+
+        CompiledPattern& compile(const std::string& pattern);
+
+        // Handles of the entities with the matching names of a compiled pattern.
+        std::vector<EntityHandle> collect(const CompiledPattern& compiled) const;
+};
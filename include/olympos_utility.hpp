@@ -6,8 +6,13 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace OlymposUtility {
     std::wstring utf8ToWString(const std::string&);
+
+    // Manhattan distance between two locations. Signed to avoid wrap around with unsigned
+    // coordinates.
+    size_t manhattanDistance(int64_t y1, int64_t x1, int64_t y2, int64_t x2);
 }
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Point to point routes over passable terrain, found with A*. Routes are cached per entity and are
+ * only planned again when the entity leaves its route, the goal changes, or a tile along the
+ * route becomes impassable. The tiles of a route are only checked again after the terrain changes.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class WorldState;
+
+class Pathfinder {
+    public:
+        // A tile location, {y, x}.
+        using Tile = std::pair<size_t, size_t>;
+
+        // Searches give up after expanding this many tiles.
+        static constexpr size_t max_expanded = 4096;
+
+        // Find a route from start to goal moving in the four cardinal directions over passable
+        // terrain. The route does not include start but does include the goal, which does not need
+        // to be passable. Empty if there is no route.
+        static std::vector<Tile> findPath(const WorldState& ws, Tile start, Tile goal);
+
+        // The next tile on the entity's route to the goal, planning a route if the cached one is
+        // no longer valid. Empty if there is no route or the entity is already at the goal.
+        std::optional<Tile> nextStep(const WorldState& ws, size_t entity_id, Tile start, Tile goal);
+
+        // Drop the cached route of an entity.
+        void forget(size_t entity_id);
+
+    private:
+        struct Route {
+            Tile goal;
+            // Tiles from the goal back to the next step, so that steps are taken off of the back.
+            std::vector<Tile> tiles;
+            // The terrain version when the tiles were last known to be passable.
+            uint64_t terrain_version = 0;
+        };
+
+        std::unordered_map<size_t, Route> routes;
+
+        // Drop the steps that the entity has already taken and check that the rest of the route
+        // still leads from start to goal over passable terrain.
+        static bool stillValid(const WorldState& ws, Route& route, Tile start, Tile goal);
+};
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Memoized target searches. Many entities search for the same few targets every tick (the player,
+ * usually), so the entities that match each target are gathered once and nearest entity searches
+ * only need to check those candidates. Candidates are found from their current locations, so
+ * movement does not invalidate them, but adding or removing a matching entity does.
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "entity_store.hpp"
+#include "trait_set.hpp"
+
+struct Entity;
+
+class Perception {
+    public:
+        // Targets with more matches than this are not worth remembering, since a spatial search
+        // will visit fewer entities than the candidate list.
+        static constexpr size_t max_candidates = 32;
+
+        struct Candidates {
+            std::vector<EntityHandle> handles;
+            // Set if there were more than max_candidates matches, in which case handles is empty.
+            bool too_many = false;
+        };
+
+        // The remembered candidates for a target, or nullptr if they have not been gathered.
+        const Candidates* recall(const TraitQuery& query) const;
+        const Candidates* recall(const std::string& name) const;
+
+        // Remember the candidates for a target. If another thread already remembered them then
+        // those are kept and returned instead.
+        const Candidates& remember(const TraitQuery& query, Candidates&& candidates);
+        const Candidates& remember(const std::string& name, Candidates&& candidates);
+
+        // Forget the candidates of any target that the entity matches. Call this when an entity is
+        // added or removed.
+        void entityChanged(const Entity& entity);
+
+        // Forget everything.
+        void clear();
+
+    private:
+        // Only a few distinct trait queries are searched for, so they are simply compared in turn.
+        // A deque so that references to candidates stay valid while other targets are added.
+        std::deque<std::pair<TraitQuery, Candidates>> trait_targets;
+        // std::map for the same reason. Names are found without copying them.
+        std::map<std::string, Candidates, std::less<>> name_targets;
+
+        // Searches run concurrently while entities decide on their actions.
+        mutable std::shared_mutex mutex;
+};
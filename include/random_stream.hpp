@@ -0,0 +1,43 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Counter based random numbers. Each stream is identified by the world seed, an entity, the tick,
+ * and the purpose of the numbers, and its values are a hash of that key and a counter. No state is
+ * shared between streams, so entities can draw numbers in any order (or in parallel) and a run
+ * with the same seed always plays out the same way.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+class RandomStream {
+    public:
+        // The purpose of the random numbers. Different purposes draw different numbers even for the
+        // same entity and tick.
+        enum class Purpose : uint64_t {
+            wander = 1,
+            description = 2
+        };
+
+        RandomStream(uint64_t seed, uint64_t entity_id, uint64_t tick, Purpose purpose);
+
+        // Satisfies UniformRandomBitGenerator so that it may be used with the standard library.
+        using result_type = uint64_t;
+        static constexpr result_type min() {
+            return 0;
+        }
+        static constexpr result_type max() {
+            return std::numeric_limits<result_type>::max();
+        }
+        result_type operator()();
+
+        // A uniformly distributed integer in [low, high]. Unlike std::uniform_int_distribution the
+        // result does not depend upon the standard library implementation.
+        int64_t uniform(int64_t low, int64_t high);
+
+    private:
+        uint64_t key;
+        uint64_t counter = 0;
+};
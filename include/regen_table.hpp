@@ -0,0 +1,56 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Per-tick regeneration of health, mana, and stamina. The derived maxima and regeneration rates of
+ * every entity with stats are cached in packed parallel arrays, so a tick is a straight pass over
+ * those arrays instead of recomputing them for every entity.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "entity_store.hpp"
+
+struct Stats;
+
+class RegenTable {
+    public:
+        // Cache the derived values of the stats for the entity. Call this again whenever the
+        // entity's base attributes change.
+        void set(EntityHandle handle, const Stats& stats);
+
+        // Stop regenerating the entity.
+        void erase(EntityHandle handle);
+
+        // The number of entities in the table and the handle of the entity in each row.
+        size_t size() const;
+        EntityHandle handle(size_t row) const;
+
+        // Compute the health, mana, and stamina gained by every row on the given tick.
+        void computeGains(size_t tick_num);
+
+        // Apply the gains from computeGains to the stats of the entity in the given row.
+        void apply(size_t row, Stats& stats) const;
+
+    private:
+        static constexpr uint32_t no_row = EntityHandle::null_slot;
+
+        // The row of each entity handle slot, or no_row.
+        std::vector<uint32_t> slot_rows;
+
+        // One row per entity, packed together.
+        std::vector<EntityHandle> handles;
+        std::vector<double> health_rate;
+        std::vector<double> mana_rate;
+        std::vector<double> stamina_rate;
+        std::vector<size_t> max_health;
+        std::vector<size_t> max_mana;
+        std::vector<size_t> max_stamina;
+
+        // Whole points gained by each row on the current tick.
+        std::vector<size_t> health_gain;
+        std::vector<size_t> mana_gain;
+        std::vector<size_t> stamina_gain;
+};
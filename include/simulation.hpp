@@ -0,0 +1,26 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * The game tick pipeline, shared by the terminal game and the headless simulation.
+ */
+
+#pragma once
+
+#include <chrono>
+
+#include "command_handler.hpp"
+#include "world_state.hpp"
+
+namespace Simulation {
+    // Time spent in each phase of the tick pipeline.
+    struct PhaseTimings {
+        std::chrono::duration<double> behaviors{0};
+        std::chrono::duration<double> commands{0};
+        std::chrono::duration<double> update{0};
+    };
+
+    // Run one tick: automated behaviors enqueue commands, all queued commands are executed, and
+    // then the world state is updated. If timings is not null the time spent in each phase is
+    // added to it.
+    void tick(WorldState& ws, CommandHandler& comham, PhaseTimings* timings = nullptr);
+}
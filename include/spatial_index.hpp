@@ -0,0 +1,81 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * A uniform grid of cells that buckets entities by location so that range queries only need to
+ * look at the entities that are near the query location.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "entity_store.hpp"
+
+class SpatialIndex {
+    public:
+        // Each cell covers cell_size x cell_size tiles.
+        SpatialIndex(size_t field_height, size_t field_width, size_t cell_size = 8);
+
+        // Add or remove an entity from the cell that contains y, x.
+        void insert(EntityHandle entity, size_t y, size_t x);
+        void erase(EntityHandle entity, size_t y, size_t x);
+
+        // Update the cell of an entity that moved from old_y, old_x to y, x.
+        void move(EntityHandle entity, size_t old_y, size_t old_x, size_t y, size_t x);
+
+        // Call visit on every entity in the cells that overlap the diamond of Manhattan distance
+        // range around (y, x). Entities outside of the diamond may still be visited, so the caller
+        // must check the distance itself.
+        template<typename Visitor>
+        void forEachNear(int64_t y, int64_t x, size_t range, Visitor&& visit) const {
+            if (cells.empty()) {
+                return;
+            }
+            // Clamp the range so that the arithmetic below cannot overflow.
+            const int64_t clamped = std::min<int64_t>(range, field_height + field_width);
+            const int64_t cell = cell_size;
+            const int64_t first_row = std::max<int64_t>(0, y - clamped) / cell;
+            const int64_t last_row = std::min<int64_t>(field_height - 1, y + clamped) / cell;
+            if (y + clamped < 0 or y - clamped >= (int64_t)field_height) {
+                return;
+            }
+            for (int64_t cell_row = first_row; cell_row <= last_row; ++cell_row) {
+                // The vertical distance from y to the nearest tile in this row of cells limits how
+                // far the diamond extends horizontally within the row.
+                const int64_t row_top = cell_row * cell;
+                const int64_t row_bottom = row_top + cell - 1;
+                int64_t y_dist = 0;
+                if (y < row_top) {
+                    y_dist = row_top - y;
+                }
+                else if (y > row_bottom) {
+                    y_dist = y - row_bottom;
+                }
+                const int64_t remaining = clamped - y_dist;
+                if (remaining < 0 or x + remaining < 0 or x - remaining >= (int64_t)field_width) {
+                    continue;
+                }
+                const int64_t first_col = std::max<int64_t>(0, x - remaining) / cell;
+                const int64_t last_col = std::min<int64_t>(field_width - 1, x + remaining) / cell;
+                for (int64_t cell_col = first_col; cell_col <= last_col; ++cell_col) {
+                    for (EntityHandle entity : cells[cell_row * cells_wide + cell_col]) {
+                        visit(entity);
+                    }
+                }
+            }
+        }
+
+    private:
+        size_t field_height;
+        size_t field_width;
+        size_t cell_size;
+        size_t cells_wide;
+
+        // Entities in each cell, in row major order.
+        std::vector<std::vector<EntityHandle>> cells;
+
+        size_t cellIndex(size_t y, size_t x) const;
+        void eraseFromCell(size_t cell_idx, EntityHandle entity);
+};
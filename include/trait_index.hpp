@@ -0,0 +1,39 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * An index from traits to the entities that have them, so that commands and searches for a trait
+ * only visit the matching entities instead of every entity in the world.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "entity_store.hpp"
+#include "trait_set.hpp"
+
+class TraitIndex {
+    public:
+        void insert(EntityHandle entity, const TraitSet& traits);
+        // Remove the entity from the lists of all of the traits that it was inserted with.
+        void erase(EntityHandle entity);
+
+        // The entities with the given trait, in no particular order.
+        const std::vector<EntityHandle>& entitiesWith(TraitId trait) const;
+
+        // The shortest list of entities among the traits of the query, which contains every entity
+        // that matches the query. The query must require at least one trait.
+        const std::vector<EntityHandle>& candidates(const TraitQuery& query) const;
+
+    private:
+        // Entities, by trait ID.
+        std::vector<std::vector<EntityHandle>> entities;
+        // The position of each entity in the list of each of its traits, by slot, so that erasing
+        // does not search the lists.
+        std::vector<std::vector<std::pair<TraitId, uint32_t>>> positions;
+
+        // The position of the entity in the list of the trait.
+        uint32_t& positionOf(EntityHandle entity, TraitId trait);
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Interned entity traits. Every trait string is assigned a small integer ID when it is first seen,
+ * and entities hold their traits as a bitmask of those IDs so that trait checks are bit tests
+ * instead of string comparisons.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using TraitId = uint32_t;
+
+namespace Traits {
+    // Get the ID for a trait, assigning a new one if the trait has not been seen before.
+    // Interning is not thread safe, so it should happen while loading lore and creating entities.
+    TraitId intern(const std::string& trait);
+
+    // Get the ID for a trait if it has been interned. Returns false if it has not been seen, in
+    // which case no entity can have it.
+    bool find(const std::string& trait, TraitId& id);
+
+    // The string for an interned trait.
+    const std::string& name(TraitId id);
+}
+
+class TraitSet {
+    public:
+        // Traits with IDs below this are stored in a fixed size bitmask. Traits are interned in
+        // the order that they are encountered while loading, so this covers all of the lore traits.
+        static constexpr size_t inline_words = 2;
+        static constexpr TraitId inline_traits = 64 * inline_words;
+
+    private:
+        std::array<uint64_t, inline_words> bits{};
+        // Any traits beyond the inline bits, kept sorted.
+        std::vector<TraitId> overflow;
+
+    public:
+        TraitSet() = default;
+
+        // Intern and add all of the given traits.
+        template<typename Iterator>
+        TraitSet(Iterator first, Iterator last) {
+            insert(first, last);
+        }
+
+        bool contains(TraitId id) const {
+            if (id < inline_traits) {
+                return bits[id / 64] & (uint64_t{1} << (id % 64));
+            }
+            return containsOverflow(id);
+        }
+
+        bool contains(const std::string& trait) const;
+
+        // True if every trait in other is also in this set.
+        bool containsAll(const TraitSet& other) const {
+            for (size_t word = 0; word < inline_words; ++word) {
+                if ((bits[word] & other.bits[word]) != other.bits[word]) {
+                    return false;
+                }
+            }
+            return other.overflow.empty() or containsAllOverflow(other);
+        }
+
+        // True if any trait in other is also in this set.
+        bool containsAny(const TraitSet& other) const {
+            for (size_t word = 0; word < inline_words; ++word) {
+                if (0 != (bits[word] & other.bits[word])) {
+                    return true;
+                }
+            }
+            return not other.overflow.empty() and containsAnyOverflow(other);
+        }
+
+        void insert(TraitId id);
+        void insert(const std::string& trait);
+
+        template<typename Iterator>
+        void insert(Iterator first, Iterator last) {
+            for (; first != last; ++first) {
+                insert(*first);
+            }
+        }
+
+        void erase(TraitId id);
+        void erase(const std::string& trait);
+
+        bool empty() const;
+
+        // The trait strings in this set, in ID order.
+        std::vector<std::string> names() const;
+
+        // The trait IDs in this set, in ID order.
+        std::vector<TraitId> ids() const;
+
+        bool operator==(const TraitSet&) const = default;
+
+    private:
+        bool containsOverflow(TraitId id) const;
+        bool containsAllOverflow(const TraitSet& other) const;
+        bool containsAnyOverflow(const TraitSet& other) const;
+};
+
+// A set of required traits, compiled once and then tested against many entities.
+struct TraitQuery {
+    TraitSet required;
+    // False if a required trait has never been interned, so nothing can match.
+    bool satisfiable = true;
+
+    TraitQuery() = default;
+    explicit TraitQuery(const std::vector<std::string>& traits);
+
+    bool matches(const TraitSet& traits) const {
+        return satisfiable and traits.containsAll(required);
+    }
+};
@@ -10,13 +10,15 @@
 
 #include <ncurses.h>
 
+#include <cstdint>
 #include <deque>
-#include <list>
 #include <string>
 #include <tuple>
 #include <vector>
 
+#include "effect_layer.hpp"
 #include "entity.hpp"
+#include "entity_store.hpp"
 
 using json = nlohmann::json;
 
@@ -29,7 +31,7 @@ namespace UserInterface {
 
     // Update all of the entities onto the given window. Also color the backgrounds of tiles to
     // indicate effect areas.
-    void updateDisplay(WINDOW* window, const std::list<Entity>& entities, const std::map<std::tuple<size_t, size_t>, std::string>& background_effects = {});
+    void updateDisplay(WINDOW* window, const EntityStore& entities, const EffectLayer& effects);
     // Clear the user input area
     void clearInput(WINDOW* window, size_t field_height, size_t field_width);
     // Setup colors
@@ -41,8 +43,8 @@ namespace UserInterface {
     // TODO FIXME The status, infolog, and hotkeys are all status window specific. UIComponent could
     // be specialized to support a status window class instead of these window specific items living
     // here.
-    // Update the status and return the last row used.
-    size_t drawStatus(WINDOW* window, const Entity& entity, size_t row, size_t column);
+    // Update the status and return the last row used. The world seed selects the description.
+    size_t drawStatus(WINDOW* window, const Entity& entity, uint64_t world_seed, size_t row, size_t column);
 
     size_t drawInfolog(WINDOW* window, size_t row, std::deque<std::vector<std::wstring>> info_log);
 
@@ -6,38 +6,203 @@
 
 #pragma once
 
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <bitset>
+#include <cstdint>
 #include <deque>
-#include <list>
+#include <filesystem>
 #include <map>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // Forward declare world state because it is used in Entity's dependencies.
 struct WorldState;
+#include "chunk_grid.hpp"
+#include "effect_layer.hpp"
 #include "entity.hpp"
+#include "entity_store.hpp"
+#include "flow_field.hpp"
+#include "name_index.hpp"
+#include "pathfinder.hpp"
+#include "perception.hpp"
+#include "random_stream.hpp"
+#include "regen_table.hpp"
+#include "spatial_index.hpp"
+#include "trait_index.hpp"
+#include "trait_set.hpp"
+
+using json = nlohmann::json;
+
+enum class EventType : uint8_t {
+    // Text from an ability's flavor template.
+    flavor,
+    // The actor dropped the target.
+    drop,
+    // The start of a new tick.
+    tick,
+};
 
+// Events are recorded compactly and only rendered into text for the observers that receive them.
 struct WorldEvent {
-    std::string message;
-    size_t y;
-    size_t x;
+    EventType type = EventType::flavor;
+    // Template with <entity>, <target>, and <slot> placeholders. Owned by the ability that logged
+    // the event, which outlives the event.
+    const std::string* flavor = nullptr;
+    size_t actor_id = 0;
+    size_t target_id = 0;
+    // The equipment slot for equip events.
+    std::string slot = "";
+    // The tick number for tick events.
+    size_t tick = 0;
+    size_t y = 0;
+    size_t x = 0;
+    // The order in which events were logged.
+    size_t sequence = 0;
 };
 
 class WorldState {
     private:
-        void updatePassable(size_t y, size_t x);
+        // Tile state and entities for one chunk of the world.
+        struct TileChunk {
+            // Number of entities that block movement on each tile, in row major order.
+            std::array<uint16_t, chunk_area> blockers{};
+            // Set for tiles that have blockers.
+            std::bitset<chunk_area> blocked;
+            // Number of impassable entities on each tile. Unlike mobs these do not move out of
+            // the way.
+            std::array<uint16_t, chunk_area> terrain_blockers{};
+            std::bitset<chunk_area> terrain_blocked;
+            // The entities located in this chunk.
+            std::vector<EntityHandle> entities;
+        };
+
+        // Chunks are allocated when an entity first enters them.
+        ChunkGrid<TileChunk> chunks;
+        // The position of each entity in its chunk's entity list, by slot.
+        std::vector<uint32_t> chunk_positions;
+
+        // Add or remove an entity from the entity list of a chunk. Removal swaps the last entity
+        // of the chunk into the hole, so it does not search the list.
+        void addToChunk(EntityHandle handle, size_t chunk);
+        void removeFromChunk(EntityHandle handle, size_t chunk);
+
+        // Add delta to the blocker count at y, x if the entity blocks movement.
+        void updateBlockers(const Entity& entity, size_t y, size_t x, int delta);
+
+        // Set for chunks whose entities have been serialized out of memory. Suspended chunks are
+        // impassable until they are resumed.
+        std::vector<bool> suspended;
+        size_t suspended_count = 0;
+        // Serialized entities of suspended chunks, when they are not written to suspend_directory.
+        std::unordered_map<size_t, std::vector<uint8_t>> suspended_entities;
+
+        // Store or retrieve the serialized entities of a suspended chunk. Retrieving removes them.
+        void storeSuspended(size_t chunk, const json& records);
+        json loadSuspended(size_t chunk);
+
+        // Serialize the entities of a chunk, remove them from the world, and free the chunk.
+        void suspendChunk(size_t chunk);
+
+        // Return the serialized entities of a suspended chunk to the world at the next update.
+        void resumeChunk(size_t chunk);
+
+        // Suspend chunks that are far from every player, resume chunks that players approach, and
+        // free chunks without entities.
+        void updateResidency();
+
+        // Incremented whenever a tile becomes passable or impassable terrain.
+        uint64_t terrain_version = 1;
 
         // The current time, in ticks. Advanced in the update function.
         size_t cur_tick = 0;
 
-        // Transient events that occur with each tick of the world.
-        std::vector<WorldEvent> events;
+        // Transient events that occur with each tick of the world, bucketed into square regions
+        // of event_region_size tiles in row major order.
+        static constexpr size_t event_region_size = 8;
+        size_t event_regions_wide;
+        std::vector<std::vector<WorldEvent>> event_regions;
+        // Regions that currently hold events, so that clearing does not visit every region.
+        std::vector<size_t> active_event_regions;
+        size_t next_event_sequence = 0;
+
+        // Names of entities removed since events were last cleared, so that events that mention
+        // them can still be rendered.
+        std::unordered_map<size_t, std::string> departed_names;
+
+        // The name of an entity for an event message.
+        std::string eventName(size_t entity_id) const;
+
+        // Render the text of an event as seen by the observer.
+        std::string renderEvent(const WorldEvent& event, size_t observer_id) const;
+
+        // Entities bucketed by location to speed up range queries.
+        SpatialIndex spatial_index;
+
+        // Entities by name to speed up name searches.
+        NameIndex name_index;
+
+        // Entities by trait, so that trait searches only visit matching entities.
+        TraitIndex trait_index;
+
+        // Remembered search targets for this tick.
+        Perception perception;
+
+        // The nearest of the remembered candidates for a target within range.
+        EntityHandle nearestCandidate(const Perception::Candidates& candidates, int64_t y, int64_t x, size_t range);
+
+        // Flow fields towards each target, and the tick when each was computed. Targets come from
+        // command arguments, so fields that have not been used recently are dropped during update.
+        std::unordered_map<std::string, std::pair<size_t, FlowField>> flow_fields;
+        static constexpr size_t flow_field_idle_ticks = 16;
+
+        // The random streams used during this tick, by entity ID and purpose. Keeping them lets an
+        // entity that draws several times in a tick continue its stream instead of restarting it.
+        std::map<std::pair<size_t, RandomStream::Purpose>, RandomStream> random_streams;
+
+        // Cached regeneration rates and maxima of entities with stats. Entries are refreshed when
+        // entities are indexed and when their stats are replaced with setStats.
+        RegenTable regen_table;
+
+        // Entities inserted while commands are executing. They join the world at the next update.
+        std::vector<Entity> pending_entities;
+
+        // Find the closest entity within range that satisfies the predicate, which is called with
+        // the entity's handle and the entity. Ties are broken by the lowest entity ID so that
+        // results do not depend upon storage order.
+        template<typename Predicate>
+        EntityHandle findNearest(int64_t y, int64_t x, size_t range, Predicate&& predicate);
+
+        // Link an entity that was just placed into storage into the indices.
+        void indexEntity(EntityHandle handle);
     public:
-        std::list<Entity> entities;
+        EntityStore entities;
+
+        // Background colors representing effects. These are drawn for part of a tick and then cleared.
+        EffectLayer tile_effects;
 
-        // Background colors representing effects.
-        // TODO FIXME HERE Update in the behavior.cpp functions, pass to UserInterface::updateDisplay in
-        // main, and clear in the update function.
-        std::map<std::tuple<size_t, size_t>, std::string> background_effects;
+        // If set, chunks farther than this many chunks from every player are suspended during
+        // update and resumed once a player comes within range again.
+        std::optional<size_t> active_chunk_radius;
+
+        // Where suspended chunks are written. If empty they are kept in memory in serialized form.
+        std::filesystem::path suspend_directory;
+
+        // All randomness in the world derives from this seed, so worlds with the same seed and
+        // commands play out the same way.
+        uint64_t seed = 0;
+
+        // Random numbers for an entity during the current tick. Calls with the same entity and
+        // purpose during a tick share one stream, so each call continues where the last one
+        // stopped. Not thread safe; numbers are drawn while commands execute.
+        RandomStream& randomStream(const Entity& entity, RandomStream::Purpose purpose);
+
+        // Number of chunks with allocated storage and number of suspended chunks.
+        size_t residentChunks() const;
+        size_t suspendedChunks() const;
 
         // Tick-persistent information and observations made by the player.
         std::deque<std::vector<std::wstring>> info_log;
@@ -45,37 +210,84 @@ class WorldState {
         size_t field_height;
         size_t field_width;
 
-        // Keep track of what is passable.
-        std::vector<std::vector<bool>> passable;
+        bool isPassable(size_t y, size_t x) const;
+
+        // True if the tile is passable or is only blocked by mobs, which may move out of the way.
+        bool isPassableTerrain(size_t y, size_t x) const;
 
-        bool isPassable(size_t y, size_t x);
+        // Changes whenever isPassableTerrain changes for any tile, so that results derived from
+        // the terrain can tell if they are out of date.
+        uint64_t terrainVersion() const;
+
+        // Cached routes between tiles, for movement that does not follow a flow field.
+        Pathfinder pathfinder;
+
+        // How far flow fields reach from their targets, in steps.
+        static constexpr uint16_t flow_field_distance = 32;
+
+        // Distances to the nearest entities with the given trait or name, computed once per tick
+        // over passable terrain and shared by every entity moving towards or away from them. This
+        // is not safe to call while entities are deciding on their actions in parallel.
+        const FlowField& flowField(const std::string& target);
 
         WorldState(size_t field_height, size_t field_width);
-        void addEntity(size_t y, size_t x, const std::string& name, const std::set<std::string>& traits);
 
-        // Returns true if the mob is moved, false otherwise.
+        // Create a new entity. This may relocate other entities in storage, so it should not be
+        // called while commands are executing.
+        EntityHandle addEntity(size_t y, size_t x, const std::string& name, const std::set<std::string>& traits);
+
+        // Place an existing entity (for example, dropped equipment) into the world at its current
+        // location. This is safe to call while commands are executing; the entity appears in the
+        // world at the next update.
+        void insertEntity(Entity&& entity);
+
+        // Remove an entity from the world. The entity can no longer be found immediately, but its
+        // storage is not reclaimed until the next update.
+        void removeEntity(EntityHandle entity);
+
+        // Returns true if the mob is moved, false otherwise. Entities that have been removed from the
+        // world are not moved.
         bool moveEntity(Entity& entity, size_t y, size_t x);
 
-        // Damage entity_i for damage health points. Repercussions may happen to the attacker.
-        void damageEntity(decltype(entities)::iterator entity_i, size_t damage, Entity& attacker);
+        // Replace the stats of an entity, for example after a level up or a change of equipment.
+        // Base attributes should only be changed through this so that regeneration uses them.
+        void setStats(EntityHandle entity, const std::optional<Stats>& stats);
+
+        // Damage the entity for damage health points. Repercussions may happen to the attacker.
+        void damageEntity(EntityHandle entity, size_t damage, Entity& attacker);
+
+        // Find the named entity, or a null handle
+        EntityHandle findEntity(const std::string& name);
+
+        // Find the entity with the lowest ID that has the given traits, or a null handle
+        EntityHandle findEntity(const std::vector<std::string>& traits);
+
+        // Find all entities with the given traits, in entity ID order. Only the entities with the
+        // least common of the traits are checked.
+        std::vector<EntityHandle> findAllEntities(const std::vector<std::string>& traits);
 
-        // Find the named entity, or entities.end()
-        decltype(entities)::iterator findEntity(const std::string& name);
+        // Find the named entity within the given range, or a null handle
+        EntityHandle findEntity(const std::string& name, int64_t y, int64_t x, size_t range);
 
-        // Find an entity with the given traits, or entities.end()
-        decltype(entities)::iterator findEntity(const std::vector<std::string>& traits);
+        // Find an entity with the given traits within the given range, or a null handle
+        EntityHandle findEntity(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range);
 
-        // Find the named entity within the given range, or entities.end()
-        decltype(entities)::iterator findEntity(const std::string& name, int64_t y, int64_t x, size_t range);
+        // Find an entity matching a precompiled trait query within the given range, or a null handle
+        EntityHandle findEntity(const TraitQuery& query, int64_t y, int64_t x, size_t range);
 
-        // Find an entity with the given traits within the given range, or entities.end()
-        decltype(entities)::iterator findEntity(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range);
+        // Find the nearest entity with the trait or name within range, like findEntity. The
+        // entities that match each target are remembered for the rest of the tick, so repeated
+        // searches for the same target only check those entities. These may be called
+        // concurrently as long as no entities are added, moved, or removed at the same time.
+        EntityHandle perceiveTrait(const std::string& trait, int64_t y, int64_t x, size_t range);
+        EntityHandle perceiveTraits(const TraitQuery& query, int64_t y, int64_t x, size_t range);
+        EntityHandle perceiveName(const std::string& name, int64_t y, int64_t x, size_t range);
 
-        // Find an entity with the given entity ID number.
-        decltype(entities)::iterator findEntity(size_t entity_id);
+        // Find an entity with the given entity ID number, or a null handle
+        EntityHandle findEntity(size_t entity_id);
 
         // Find all entities with the tiven traits within the given range.
-        std::vector<decltype(entities)::iterator> findEntities(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range);
+        std::vector<EntityHandle> findEntities(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range);
 
         // Initialize layers, such as passable areas, and named entities.
         void initialize();
@@ -86,8 +298,8 @@ class WorldState {
         // Log an event at the given location.
         void logEvent(WorldEvent event);
 
-        // Fetch events with a given range of a coordinate.
-        std::vector<std::string> getLocalEvents(size_t y, size_t x, size_t range);
+        // Fetch the text of events within range of the observer, in the order they were logged.
+        std::vector<std::string> getLocalEvents(const Entity& observer, size_t range) const;
 
         // Clear events
         void clearEvents();
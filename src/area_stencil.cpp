@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Areas of effect rasterized into offsets from the acting entity. The shape of an area only
+ * depends upon the ability, its direction, and its range, so each shape is made once and reused
+ * every time the ability is used.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "area_stencil.hpp"
+
+AreaStencil::AreaStencil(std::vector<Offset> offsets) : sorted_offsets(std::move(offsets)) {
+    std::sort(sorted_offsets.begin(), sorted_offsets.end());
+    sorted_offsets.erase(std::unique(sorted_offsets.begin(), sorted_offsets.end()), sorted_offsets.end());
+    for (const auto& [y_offset, x_offset] : sorted_offsets) {
+        max_reach = std::max<size_t>(max_reach, std::abs(y_offset) + std::abs(x_offset));
+    }
+}
+
+AreaStencil AreaStencil::diamond(int64_t range) {
+    std::vector<Offset> offsets;
+    for (int64_t y_offset = -range; y_offset <= range; ++y_offset) {
+        int64_t width = range - std::abs(y_offset);
+        for (int64_t x_offset = -width; x_offset <= width; ++x_offset) {
+            offsets.push_back({y_offset, x_offset});
+        }
+    }
+    return AreaStencil(std::move(offsets));
+}
+
+AreaStencil AreaStencil::cone(int64_t first_distance, int64_t last_distance, double width_base,
+        double width_slope, const std::array<double, 2>& direction, const std::array<double, 2>& side_direction) {
+    std::vector<Offset> offsets;
+    for (int64_t distance = first_distance; distance <= last_distance; ++distance) {
+        int width = floor(width_base) + floor(width_slope * (distance - 1));
+        for (int lateral = -std::trunc((width-1) / 2); lateral <= std::trunc((width-1) / 2); ++lateral) {
+            offsets.push_back({
+                static_cast<int64_t>(distance * direction[0] + lateral * side_direction[0]),
+                static_cast<int64_t>(distance * direction[1] + lateral * side_direction[1])});
+        }
+    }
+    return AreaStencil(std::move(offsets));
+}
+
+const std::vector<AreaStencil::Offset>& AreaStencil::offsets() const {
+    return sorted_offsets;
+}
+
+size_t AreaStencil::reach() const {
+    return max_reach;
+}
+
+bool AreaStencil::contains(int64_t y_offset, int64_t x_offset) const {
+    return std::binary_search(sorted_offsets.begin(), sorted_offsets.end(), Offset{y_offset, x_offset});
+}
+
+std::vector<std::tuple<size_t, size_t>> AreaStencil::tiles(size_t y, size_t x) const {
+    std::vector<std::tuple<size_t, size_t>> covered;
+    covered.reserve(sorted_offsets.size());
+    for (const auto& [y_offset, x_offset] : sorted_offsets) {
+        int64_t tile_y = y + y_offset;
+        int64_t tile_x = x + x_offset;
+        if (0 <= tile_y and 0 <= tile_x) {
+            covered.push_back({tile_y, tile_x});
+        }
+    }
+    return covered;
+}
@@ -8,15 +8,18 @@
  * to check the advancement of commands and behaviors.
  */
 
+#include <array>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <limits>
-#include <random>
 #include <ranges>
 #include <regex>
+#include <stdexcept>
 #include <tuple>
+#include <utility>
 
+#include "area_stencil.hpp"
 #include "behavior.hpp"
 
 #include <nlohmann/json.hpp>
@@ -32,7 +35,7 @@ namespace Behavior {
     std::map<std::string, BehaviorSet> loaded_behaviors;
 
     // No op function
-    void noop_function(WorldState&, const vector<string>&) {
+    void noop_function(Entity&, WorldState&, const vector<string>&) {
         // Lots of nothing here.
     }
 
@@ -96,10 +99,121 @@ namespace Behavior {
         return AbilityRange::unknown;
     }
 
+    TileOffset decodeOffset(const json& offset_json) {
+        TileOffset offset;
+        if (offset_json.contains("y")) {
+            offset.y = offset_json.at("y").get<int>();
+        }
+        if (offset_json.contains("x")) {
+            offset.x = offset_json.at("x").get<int>();
+        }
+        return offset;
+    }
+
+    std::array<double, 2> decodeDirection(const std::string& ability, const json& direction_json) {
+        std::vector<double> direction = direction_json.get<std::vector<double>>();
+        if (2 != direction.size()) {
+            throw std::runtime_error("Ability " + ability + " has a direction without a y and x component");
+        }
+        return {direction[0], direction[1]};
+    }
+
+    // Decode the effects json of an ability so that using the ability never needs to look at json.
+    Effects decodeEffects(const Ability& ability, const json& effects_json) {
+        Effects effects;
+        if (effects_json.contains("range")) {
+            effects.range = effects_json.at("range").get<size_t>();
+        }
+
+        if (AbilityType::movement == ability.type) {
+            if (effects_json.contains("distance")) {
+                const json& distances = effects_json.at("distance");
+                if (distances.contains("x") or distances.contains("y")) {
+                    effects.movement = MovementType::fixed;
+                    effects.distance = decodeOffset(distances);
+                }
+                else if (distances.contains("random_min") and distances.contains("random_max")) {
+                    effects.movement = MovementType::random;
+                    effects.random_min = distances.at("random_min").get<int>();
+                    effects.random_max = distances.at("random_max").get<int>();
+                }
+                else {
+                    throw std::runtime_error("Ability " + ability.name + " has a distance without an offset or random range");
+                }
+            }
+            else if (effects_json.contains("minimize distance")) {
+                effects.movement = MovementType::minimize_distance;
+            }
+            else if (effects_json.contains("maximize distance")) {
+                effects.movement = MovementType::maximize_distance;
+            }
+            else if (effects_json.contains("maintain distance")) {
+                effects.movement = MovementType::maintain_distance;
+            }
+        }
+
+        if (effects_json.contains("damage")) {
+            const json& damage_effects = effects_json.at("damage");
+            effects.damage.base = damage_effects.value("base", 0.0);
+            effects.damage.strength = damage_effects.value("strength", 0.0);
+            effects.damage.domain = damage_effects.value("domain", 0.0);
+            effects.damage.aura = damage_effects.value("aura", 0.0);
+            effects.damage.reflexes = damage_effects.value("reflexes", 0.0);
+        }
+
+        if (AbilityArea::cone == ability.area or AbilityArea::radius == ability.area) {
+            if (not effects_json.contains("area")) {
+                throw std::runtime_error("Ability " + ability.name + " has no area effect");
+            }
+            const json& area_effects = effects_json.at("area");
+            AreaEffect area;
+            if (AbilityArea::cone == ability.area) {
+                std::vector<double> range = area_effects.at("range").get<std::vector<double>>();
+                if (2 != range.size()) {
+                    throw std::runtime_error("Ability " + ability.name + " needs a minimum and maximum cone range");
+                }
+                area.range_min = range[0];
+                area.range_max = range[1];
+                area.width_base = area_effects.at("width_base").get<double>();
+                area.width_slope = area_effects.at("width_slope").get<double>();
+            }
+            else {
+                area.range_max = area_effects.at("range").get<double>();
+            }
+            area.vitality_mod = area_effects.value("vitality_mod", 0.0);
+            effects.area = area;
+        }
+
+        for (const std::string& option : ability.argument_options) {
+            if (not effects_json.contains(option)) {
+                continue;
+            }
+            const json& option_json = effects_json.at(option);
+            OptionEffect option_effect;
+            if (option_json.contains("distance")) {
+                option_effect.distance = decodeOffset(option_json.at("distance"));
+            }
+            if (AbilityArea::cone == ability.area) {
+                option_effect.direction = decodeDirection(ability.name, option_json.at("direction"));
+                option_effect.side_direction = decodeDirection(ability.name, option_json.at("side_direction"));
+            }
+            effects.options.insert({option, option_effect});
+        }
+
+        if (effects_json.contains("information")) {
+            effects_json.at("information").get_to(effects.information);
+        }
+        if (effects_json.contains("equip")) {
+            effects.equip = effects_json.at("equip").get<std::string>();
+        }
+        return effects;
+    }
+
     Behavior::Ability::Ability(const std::string& name, nlohmann::json& ability_json) {
         // TODO Use NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE macro to automatically define the json to
         // ability conversion?
         this->name = name;
+        opcode = Commands::intern(name);
         type = ability_json.at("type").get<AbilityType>();
         area = stoArea(ability_json.at("area").get<string>());
         range = stoRange(ability_json.at("range").get<string>());
@@ -112,9 +226,33 @@ namespace Behavior {
         if (ability_json.contains("default arguments")) {
             ability_json.at("default arguments").get_to(default_args);
         }
-        ability_json.at("effects").get_to(effects);
+        if (not arguments.empty() and "or" == arguments.front()) {
+            argument_options.assign(arguments.begin()+1, arguments.end());
+        }
+        target_argument = arguments.end() != std::find(arguments.begin(), arguments.end(), "<target>");
+        try {
+            effects = decodeEffects(*this, ability_json.at("effects"));
+        }
+        catch (const json::exception& error) {
+            throw std::runtime_error("Ability " + name + " has malformed effects: " + error.what());
+        }
         ability_json.at("prereqs").get_to(prereqs);
         ability_json.at("constraints").get_to(constraints);
+        // Intern the constraints so that checking them is a mask test.
+        if (not constraints.empty() and "or" == constraints.front()) {
+            any_constraint = true;
+            constraint_traits.insert(constraints.begin()+1, constraints.end());
+        }
+        else {
+            constraint_traits.insert(constraints.begin(), constraints.end());
+        }
+    }
+
+    bool Behavior::Ability::meetsConstraints(const TraitSet& traits) const {
+        if (any_constraint) {
+            return traits.containsAny(constraint_traits);
+        }
+        return traits.containsAll(constraint_traits);
     }
 
     Behavior::AbilitySet::AbilitySet(const std::string& name, nlohmann::json& behavior_json) {
@@ -124,244 +262,171 @@ namespace Behavior {
         abilities = std::map<std::string, Ability>();
 
         for (auto& [ability_name, ability_json] : behavior_json.at("abilities").get<std::map<std::string, json>>()) {
-            abilities.insert({ability_name, Ability(ability_name, ability_json)});
+            // The function refers to the ability, so make it once the ability is in place.
+            Ability& ability = abilities.insert({ability_name, Ability(ability_name, ability_json)}).first->second;
+            ability.function = ability.makeFunction();
         }
     }
 
-    void replaceSubstring(std::string& str, const std::string& target, const std::string& replacement) {
-        std::string::size_type index = str.find(target);
-        if (index != std::string::npos) {
-            str.replace(index, index+target.size(), replacement);
-        }
+    // Log an event from an ability's flavor text. The text is only rendered if someone observes it.
+    void logFlavor(WorldState& ws, const std::string& flavor, const Entity& actor, size_t target_id, size_t y, size_t x) {
+        ws.logEvent({.flavor = &flavor, .actor_id = actor.entity_id, .target_id = target_id, .y = y, .x = x});
     }
 
-    bool actionBoilerplateCheck(Entity& actor, WorldState& ws, const Ability& ability, const std::vector<std::string>& arguments, size_t min_arguments, const std::string& fail_string) {
+    bool actionBoilerplateCheck(Entity& actor, WorldState& ws, const Ability& ability, const std::vector<std::string>& arguments, size_t min_arguments) {
         // Verify that the actor can take this action
         if (ability.stamina > actor.stats.value().stamina) {
             // TODO Should there be a generic low stamina failure string?
             // TODO Prepend an exhausted string to the fail string.
-            ws.logEvent({fail_string, actor.y, actor.x});
+            logFlavor(ws, ability.fail_flavor, actor, 0, actor.y, actor.x);
             return false;
         }
 
         // Find the target from the arguments.
         if (arguments.size() < min_arguments) {
             // TODO Should there be a generic "improper arguments" failure string?
-            ws.logEvent({fail_string, actor.y, actor.x});
+            logFlavor(ws, ability.fail_flavor, actor, 0, actor.y, actor.x);
             return false;
         }
         return true;
     }
 
-    // Find the target of a range 1 skill or ability, or end iterator if there is no target.
-    // TODO FIXME multiple arguments are just members of an ability, just pass that here.
-    // TODO FIXME Or maybe this should just be a member function of Ability?
-    std::tuple<std::list<Entity>::iterator, std::tuple<size_t, size_t>> findOneTarget(WorldState& ws, Entity& actor, const std::map<std::string, nlohmann::json>& effects,
-            const vector<string>& expected_args, const vector<string>& default_args, const vector<string>& args) {
+    // Find the target of a range 1 skill or ability, or a null handle if there is no target.
+    std::tuple<EntityHandle, std::tuple<size_t, size_t>> findOneTarget(WorldState& ws, Entity& actor, const Ability& ability,
+            const vector<string>& args) {
         // Default to having no target.
-        std::list<Entity>::iterator target = ws.entities.end();
+        EntityHandle target;
         std::tuple<size_t, size_t> target_location{std::numeric_limits<size_t>::max(), std::numeric_limits<size_t>::max()};
 
+        // Expecting a single argument. Start with the default, but replace it with any supplied
+        // argument if present.
+        const std::string* arg = nullptr;
+        if (0 < args.size()) {
+            arg = &args.at(0);
+        }
+        else if (0 < ability.default_args.size()) {
+            arg = &ability.default_args.at(0);
+        }
+        // See if we match an argument option
         bool argument_consumed = false;
-        // Find the ability range
-        size_t ability_range = 0;
-        if (effects.contains("range")) {
-            ability_range = effects.at("range");
-        }
-        // Are there argument options?
-        if (0 < expected_args.size() and expected_args[0] == "or") {
-            // Expecting a single argument. Start with the default, but replace it with any supplied
-            // argument if present.
-            std::string arg = "";
-            if (0 < args.size()) {
-                arg = args.at(0);
-            }
-            else if (0 < default_args.size()) {
-                arg = default_args.at(0);
-            }
-            // Skip the "or" when looking at possible arguments.
-            auto arg_options = std::ranges::subrange(expected_args.begin()+1, expected_args.end());
-            // See if we match an argument
-            if (arg_options.end() != std::find(arg_options.begin(), arg_options.end(), arg)) {
-                argument_consumed = true;
-                // TODO FIXME What about the forward option?
-                // Find the effects of this argument.
-                if (effects.contains(arg)) {
-                    // The arguments should control which direction to check for a target.
-                    if (effects.at(arg).contains("distance")) {
-                        size_t target_y = actor.y;
-                        size_t target_x = actor.x;
-                        auto& distances = effects.at(arg).at("distance");
-                        if (distances.contains("y")) {
-                            target_y += distances.at("y").get<int>();
-                        }
-                        if (distances.contains("x")) {
-                            target_x += distances.at("x").get<int>();
-                        }
-                        target_location = std::make_tuple(target_y, target_x);
-                        // Now find the target at that location if one exists.
-                        // It is possible that there are multiple entities in that tile. This
-                        // will find the first one arbitrarily.
-                        target = std::find_if(ws.entities.begin(), ws.entities.end(),
-                            [=](Entity& ent) { return ent.y == target_y and ent.x == target_x;});
-                    }
+        if (nullptr != arg and ability.argument_options.end() != std::find(ability.argument_options.begin(), ability.argument_options.end(), *arg)) {
+            argument_consumed = true;
+            // TODO FIXME What about the forward option?
+            // The arguments should control which direction to check for a target.
+            auto option = ability.effects.options.find(*arg);
+            if (option != ability.effects.options.end() and option->second.distance) {
+                size_t target_y = actor.y + option->second.distance->y;
+                size_t target_x = actor.x + option->second.distance->x;
+                target_location = std::make_tuple(target_y, target_x);
+                // Now find the target at that location if one exists.
+                // It is possible that there are multiple entities in that tile. This
+                // will find the first one arbitrarily.
+                std::vector<EntityHandle> on_tile = ws.findEntities({}, target_y, target_x, 0);
+                if (not on_tile.empty()) {
+                    target = on_tile.front();
                 }
             }
         }
         // Match an arbitrary string for a <target>
-        if (not argument_consumed and expected_args.end() != std::find(expected_args.begin(), expected_args.end(), ("<target>"))) {
+        if (not argument_consumed and ability.target_argument) {
             // Going to have to search for this target by name. Check for a passed argument, and if
             // there is none present used the default if it exists.
-            std::string target_name = "";
-            if (0 < args.size()) {
-                target_name = args[0];
-            }
-            else if (0 < default_args.size()) {
-                target_name = default_args[0];
-            }
+            static const std::string no_name;
+            const std::string& target_name = nullptr == arg ? no_name : *arg;
             // Assign the target.
-            target = ws.findEntity(target_name, actor.y, actor.x, ability_range);
+            target = ws.perceiveName(target_name, actor.y, actor.x, ability.effects.range);
             // If this wasn't a name, try searching for a trait
-            if (target == ws.entities.end()) {
-                target = ws.findEntity(std::vector<std::string>{target_name}, actor.y, actor.x, ability_range);
+            if (not target) {
+                target = ws.perceiveTrait(target_name, actor.y, actor.x, ability.effects.range);
             }
-            if (target != ws.entities.end()) {
-                target_location = std::make_tuple(target->y, target->x);
+            if (Entity* target_entity = ws.entities.get(target)) {
+                target_location = std::make_tuple(target_entity->y, target_entity->x);
             }
         }
-        // Finally return whatever iterator location was discovered.
+        // Finally return whatever target location was discovered.
         return {target, target_location};
     }
 
-    // Find the target of a radius skill or ability, or end iterator if there are no targets.
-    std::tuple<std::vector<std::list<Entity>::iterator>, std::set<std::tuple<size_t, size_t>>> findRadiusTarget(WorldState& ws, Entity& actor, const std::map<std::string, nlohmann::json>& effects,
-            const vector<string>&, const vector<string>&, const vector<string>&) {
-        // Read in the information about the radius area of effect
-        const json& area_effects = effects.at("area");
-        double range = area_effects.at("range").get<double>();
+    // Stencils for the areas of effect of abilities, by ability, direction, and range.
+    AreaStencils area_stencils;
+
+    // The entities on the tiles of a stencil centered on y, x. A single index search covers the
+    // stencil so the cost depends upon the nearby entities rather than the number of tiles.
+    std::vector<EntityHandle> findStencilTargets(WorldState& ws, const AreaStencil& stencil, size_t y, size_t x) {
+        std::vector<EntityHandle> targets = ws.findEntities({}, y, x, stencil.reach());
+        std::erase_if(targets, [&](EntityHandle handle) {
+            const Entity& target = ws.entities.at(handle);
+            return not stencil.contains((int64_t)target.y - (int64_t)y, (int64_t)target.x - (int64_t)x);
+        });
+        return targets;
+    }
+
+    // Find the target of a radius skill or ability, or an empty vector if there are no targets.
+    std::tuple<std::vector<EntityHandle>, std::vector<std::tuple<size_t, size_t>>> findRadiusTarget(WorldState& ws, Entity& actor, const Ability& ability,
+            const vector<string>&) {
         // Calculate modifiers from entity attributes
         // TODO Modifiers from other attributes
-        double vitality_mod = 0;
-        if (area_effects.contains("vitality_mod")) {
-            vitality_mod = area_effects.at("vitality_mod").get<double>();
+        const AreaEffect& area = ability.effects.area.value();
+        double range = floor(area.vitality_mod * actor.stats.value().vitality + area.range_max);
+        if (range < 0) {
+            return {};
         }
-        range = floor(vitality_mod * actor.stats.value().vitality + range);
 
         // Radial effects don't use arguments.
-        // Find all entities within the actor's range
-        std::vector<std::list<Entity>::iterator> targets = ws.findEntities(std::vector<std::string>{}, actor.y, actor.x, range);
-        // Fill in the area_of_effect as well.
-        std::set<std::tuple<size_t, size_t>> area_of_effect;
-        for (size_t step = 0; step <= range; ++step) {
-            // For each distance in the range, find all combinations of y and x
-            for (size_t y_dist = 0; y_dist <= step; ++y_dist) {
-                size_t x_dist = step - y_dist;
-                for (int ydir = -1; ydir <= 1; ydir += 2) {
-                    for (int xdir = -1; xdir <= 1; xdir += 2) {
-                        // Don't insert a position that would have a negative coordinate.
-                        size_t target_y = actor.y + (ydir * y_dist);
-                        size_t target_x = actor.x + (xdir * x_dist);
-                        if ((1 == ydir or y_dist <= actor.y) and
-                            (1 == xdir or x_dist <= actor.x)) {
-                            area_of_effect.insert({target_y, target_x});
-                        }
-                    }
-                }
-            }
-        }
-        // Finally return whatever iterator locations were discovered.
-        return {targets, area_of_effect};
+        const AreaStencil& stencil = area_stencils.get(&ability, "", range,
+            [&]() {return AreaStencil::diamond(range);});
+        return {findStencilTargets(ws, stencil, actor.y, actor.x), stencil.tiles(actor.y, actor.x)};
     }
 
-    // Find the target of a cone shaped skill or ability, or end iterator if there are no targets.
-    // TODO FIXME multiple arguments are just members of an ability, just pass that here.
-    // TODO FIXME Or maybe this should just be a member function of Ability?
-    std::tuple<std::vector<std::list<Entity>::iterator>, std::set<std::tuple<size_t, size_t>>> findConeTarget(WorldState& ws, Entity& actor, const std::map<std::string, nlohmann::json>& effects,
-            const vector<string>& expected_args, const vector<string>& default_args, const vector<string>& args) {
-        // Read in the information about the cone area of effect
-        const json& area_effects = effects.at("area");
-        std::vector<double> range = area_effects.at("range").get<std::vector<double>>();
-        double width_base = area_effects.at("width_base").get<double>();
-        double width_slope = area_effects.at("width_slope").get<double>();
+    // Find the target of a cone shaped skill or ability, or an empty vector if there are no targets.
+    std::tuple<std::vector<EntityHandle>, std::vector<std::tuple<size_t, size_t>>> findConeTarget(WorldState& ws, Entity& actor, const Ability& ability,
+            const vector<string>& args) {
         // Calculate modifiers from entity attributes
         // TODO Modifiers from other attributes
-        double vitality_mod = 0;
-        if (area_effects.contains("vitality_mod")) {
-            vitality_mod = area_effects.at("vitality_mod").get<double>();
-        }
-        range[1] = floor(vitality_mod * actor.stats.value().vitality + range[1]);
+        const AreaEffect& area = ability.effects.area.value();
+        double range_max = floor(area.vitality_mod * actor.stats.value().vitality + area.range_max);
 
         // Default to having no target.
-        std::vector<std::list<Entity>::iterator> targets;
-        std::set<std::tuple<size_t, size_t>> area_of_effect;
+        std::vector<EntityHandle> targets;
+        std::vector<std::tuple<size_t, size_t>> area_of_effect;
+        // Expecting a single argument. Start with the default, but replace it with any supplied
+        // argument if present.
+        static const std::string no_name;
+        const std::string* arg = &no_name;
+        if (0 < args.size()) {
+            arg = &args.at(0);
+        }
+        else if (0 < ability.default_args.size()) {
+            arg = &ability.default_args.at(0);
+        }
+        // See if we match an argument option
         bool argument_consumed = false;
-        // Are there argument options?
-        if (0 < expected_args.size() and expected_args[0] == "or") {
-            // Expecting a single argument. Start with the default, but replace it with any supplied
-            // argument if present.
-            std::string arg = "";
-            if (not default_args.empty()) {
-                arg = default_args.at(0);
-            }
-            if (0 < args.size()) {
-                arg = args.at(0);
-            }
-            // Skip the "or" when looking at possible arguments.
-            auto arg_options = std::ranges::subrange(expected_args.begin()+1, expected_args.end());
-            // See if we match an argument
-            if (arg_options.end() != std::find(arg_options.begin(), arg_options.end(), arg)) {
-                argument_consumed = true;
-                // TODO FIXME What about the forward option?
-                // Find the effects of this argument.
-                if (effects.contains(arg)) {
-                    // The direction (in [y component, x component]) and the vector direction of the
-                    // left and right sides.
-                    std::vector<double> direction = effects.at(arg).at("direction").get<std::vector<double>>();
-                    std::vector<double> side_direction = effects.at(arg).at("side_direction").get<std::vector<double>>();
-
-                    for (int distance = floor(range[0]); distance <= range[1]; ++distance) {
-                        int width = floor(width_base) + floor(width_slope * (distance - 1));
-                        for (int lateral = -std::trunc((width-1) / 2); lateral <= std::trunc((width-1) / 2); ++lateral) {
-                            // Use the directions to calculate the point being searched.
-                            size_t target_y = actor.y + distance * direction[0] + lateral * side_direction[0];
-                            size_t target_x = actor.x + distance * direction[1] + lateral * side_direction[1];
-                            area_of_effect.insert({target_y, target_x});
-                            // Now find targets at that location if they exist.
-                            std::list<Entity>::iterator target = ws.entities.begin();
-                            while (target != ws.entities.end()) {
-                                target = std::find_if(target, ws.entities.end(),
-                                    [=](Entity& ent) { return ent.y == target_y and ent.x == target_x;});
-                                // If we found another match then add it to the targets.
-                                if (target != ws.entities.end()) {
-                                    targets.push_back(target);
-                                    // Prepare for the next iteration of the loop
-                                    target = std::next(target);
-                                }
-                            }
-                        }
-                    }
-                }
+        if (ability.argument_options.end() != std::find(ability.argument_options.begin(), ability.argument_options.end(), *arg)) {
+            argument_consumed = true;
+            // TODO FIXME What about the forward option?
+            auto option = ability.effects.options.find(*arg);
+            if (option != ability.effects.options.end()) {
+                const AreaStencil& stencil = area_stencils.get(&ability, *arg, range_max,
+                    [&]() {
+                        return AreaStencil::cone(floor(area.range_min), range_max, area.width_base, area.width_slope,
+                            option->second.direction, option->second.side_direction);
+                    });
+                targets = findStencilTargets(ws, stencil, actor.y, actor.x);
+                area_of_effect = stencil.tiles(actor.y, actor.x);
             }
         }
         // Match an arbitrary string for a <target>
-        if (not argument_consumed and expected_args.end() != std::find(expected_args.begin(), expected_args.end(), ("<target>"))) {
-            // Going to have to search for this target by name. Check for a passed argument, and if
-            // there is none present used the default if it exists.
-            std::string target_name = "";
-            if (0 < args.size()) {
-                target_name = args[0];
-            }
-            else if (0 < default_args.size()) {
-                target_name = default_args[0];
-            }
+        if (not argument_consumed and ability.target_argument) {
+            // Going to have to search for this target by name.
+            const std::string& target_name = *arg;
             // Assign the target.
-            auto target = ws.findEntity(target_name, actor.y, actor.x, range[1]);
+            auto target = ws.perceiveName(target_name, actor.y, actor.x, range_max);
             // If this wasn't a name, try searching for a trait
             // TODO FIXME Should this match multiples?
-            if (target == ws.entities.end()) {
-                target = ws.findEntity(std::vector<std::string>{target_name}, actor.y, actor.x, range[1]);
+            if (not target) {
+                target = ws.perceiveTrait(target_name, actor.y, actor.x, range_max);
             }
-            if (target != ws.entities.end()) {
+            if (target) {
                 targets.push_back(target);
             }
         }
@@ -370,10 +435,46 @@ namespace Behavior {
     }
 
 
+    // Choose the passable neighboring tile that descends the flow field (or ascends it when moving
+    // away). Ties prefer moving along the axis with the larger distance to the target, and then
+    // towards the target when moving closer or away from it otherwise. The location is unchanged
+    // if no neighbor is an improvement.
+    void flowStep(const FlowField& field, bool closer, const Entity& actor, const WorldState& ws,
+        int y_dist, int x_dist, size_t& next_y, size_t& next_x) {
+        // Steps towards the target along each axis. A distance of 0 breaks towards the positive
+        // direction, like the straight line calculation.
+        int y_step = 0 < y_dist ? -1 : 1;
+        int x_step = 0 < x_dist ? -1 : 1;
+        if (not closer) {
+            y_step = -y_step;
+            x_step = -x_step;
+        }
+        std::array<std::pair<int, int>, 4> moves{{{y_step, 0}, {-y_step, 0}, {0, x_step}, {0, -x_step}}};
+        if (abs(y_dist) < abs(x_dist)) {
+            moves = {{{0, x_step}, {0, -x_step}, {y_step, 0}, {-y_step, 0}}};
+        }
+
+        uint16_t best = field.distance(actor.y, actor.x);
+        for (auto [dy, dx] : moves) {
+            size_t y = actor.y + dy;
+            size_t x = actor.x + dx;
+            if (not ws.isPassable(y, x)) {
+                continue;
+            }
+            // Unreachable tiles are beyond the field, which is as far away as it gets.
+            uint16_t distance = field.distance(y, x);
+            if (closer ? distance < best : distance > best) {
+                best = distance;
+                next_y = y;
+                next_x = x;
+            }
+        }
+    }
+
     // A function meant for binding that increases or decreases one entity's distance from another.
-    void changeDistance(Entity& actor, const Ability& ability, std::string event_string, std::string fail_string, size_t desired_distance, WorldState& ws, const std::vector<std::string>& arguments) {
+    void changeDistance(const Ability& ability, size_t desired_distance, Entity& actor, WorldState& ws, const std::vector<std::string>& arguments) {
         // Verify that this action could be taken.
-        if (not actionBoilerplateCheck(actor, ws, ability, arguments, 1, fail_string)) {
+        if (not actionBoilerplateCheck(actor, ws, ability, arguments, 1)) {
             return;
         }
 
@@ -384,27 +485,41 @@ namespace Behavior {
         if (actor.stats) {
             detection_range = actor.stats.value().detectionRange();
         }
-        auto target_i = ws.findEntity(target_name, actor.y, actor.x, detection_range);
+        Entity* target_i = ws.entities.get(ws.perceiveName(target_name, actor.y, actor.x, detection_range));
 
         // If the target was not found then take no action.
-        if (target_i == ws.entities.end()) {
+        if (nullptr == target_i) {
             // Check to see if this is a trait rather than a name.
-            target_i = ws.findEntity(std::vector<string>{target_name}, actor.y, actor.x, detection_range);
-            if (target_i == ws.entities.end()) {
+            target_i = ws.entities.get(ws.perceiveTrait(target_name, actor.y, actor.x, detection_range));
+            if (nullptr == target_i) {
                 return;
             }
         }
 
         // If the target entity was found then calculate how to move closer or farther.
-        // There won't be any pathing, this is just a straight line calculation.
         int y_dist = (int)actor.y - target_i->y;
         int x_dist = (int)actor.x - target_i->x;
         size_t distance = abs(y_dist) + abs(x_dist);
         // See if this entity wants to move closer or further
         size_t next_y_location = actor.y;
         size_t next_x_location = actor.x;
+        // Walk around obstacles by following the shared flow field from the target. If the actor
+        // is out of the field's reach then follow a route to the target when moving closer, or
+        // fall back to a straight line calculation.
+        const FlowField& field = ws.flowField(target_name);
+        std::optional<Pathfinder::Tile> route_step;
+        if (distance != desired_distance and FlowField::unreachable != field.distance(actor.y, actor.x)) {
+            flowStep(field, distance > desired_distance, actor, ws, y_dist, x_dist, next_y_location, next_x_location);
+        }
+        else if (distance > desired_distance and
+            (route_step = ws.pathfinder.nextStep(ws, actor.entity_id, {actor.y, actor.x}, {target_i->y, target_i->x}))) {
+            // The last step is onto the target itself, which is not possible.
+            if (route_step.value() != Pathfinder::Tile{target_i->y, target_i->x}) {
+                std::tie(next_y_location, next_x_location) = route_step.value();
+            }
+        }
         // Move closer?
-        if (distance > desired_distance) {
+        else if (distance > desired_distance) {
             // Determine the sign of movement and check if that space is passable.
             bool y_move_possible = (0 < y_dist and ws.isPassable(actor.y-1, actor.x)) or
                                    (0 > y_dist and ws.isPassable(actor.y+1, actor.x));
@@ -461,118 +576,80 @@ namespace Behavior {
         // reduce the stamina cost from the actor's stamina if the action occurred.
         if ((next_y_location != actor.y or next_x_location != actor.x) ) {
             if (ws.moveEntity(actor, next_y_location, next_x_location)) {
-                replaceSubstring(event_string, "<target>", target_i->name);
                 actor.stats.value().stamina -= ability.stamina;
-                // TODO Event string setup on the calling side
-                ws.logEvent({event_string, actor.y, actor.x});
+                logFlavor(ws, ability.flavor, actor, target_i->entity_id, actor.y, actor.x);
             }
         }
         else {
             // TODO The failure comes from being unable to move. Is it necessary to have this string
             // set in the json?
-            ws.logEvent({fail_string, actor.y, actor.x});
+            logFlavor(ws, ability.fail_flavor, actor, target_i->entity_id, actor.y, actor.x);
         }
     }
 
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeConditionalMoveFunction(Entity& entity) const {
-        // Prepare a flavor string to go into the event log whenever this behavior occurs.
-        // Fill in some fields in advance.
-        std::string event_string = flavor;
-        std::string fail_string = fail_flavor;
-        // If this is the player then use "You" instead of the entity name.
-        if (entity.traits.contains("player")) {
-            replaceSubstring(event_string, "<entity>", "You");
-            replaceSubstring(fail_string, "<entity>", "You");
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeConditionalMoveFunction() const {
+        bool targeted = not arguments.empty() and arguments.at(0) == "<target>";
+        if (MovementType::minimize_distance == effects.movement and targeted) {
+            return std::bind_front(changeDistance, std::cref(*this), 0);
         }
-        else {
-            replaceSubstring(event_string, "<entity>", entity.name);
-            replaceSubstring(fail_string, "<entity>", entity.name);
-        }
-
-        if (effects.contains("minimize distance") and arguments.at(0) == "<target>") {
-            return std::bind_front(changeDistance, std::ref(entity), std::cref(*this), event_string, fail_string, 0);
+        else if (MovementType::maximize_distance == effects.movement and targeted) {
+            return std::bind_front(changeDistance, std::cref(*this), std::numeric_limits<size_t>::max()/2);
         }
-        else if (effects.contains("maximize distance") and arguments.at(0) == "<target>") {
-            return std::bind_front(changeDistance, std::ref(entity), std::cref(*this), event_string, fail_string, std::numeric_limits<size_t>::max()/2);
-        }
-        else if (effects.contains("maintain distance") and
+        else if (MovementType::maintain_distance == effects.movement and
                  arguments == vector<string>{"<target>", "range"}) {
-            auto bound_fun = std::bind_front(changeDistance, std::ref(entity), std::cref(*this), event_string, fail_string);
-            return [=](WorldState& ws, const std::vector<std::string>& args) {
+            auto bound_fun = std::bind_front(changeDistance, std::cref(*this));
+            return [=](Entity& actor, WorldState& ws, const std::vector<std::string>& args) {
                 size_t desired_distance = std::stoull(args.at(1));
-                return bound_fun(desired_distance, ws, args);
+                return bound_fun(desired_distance, actor, ws, args);
             };
         }
         // Otherwise return a nothing
         return noop_function;
     }
 
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeLinearMoveFunction(Entity& entity) const {
-        // Prepare a flavor string to go into the event log whenever this behavior occurs.
-        // Fill in some fields in advance.
-        std::string event_string = flavor;
-        std::string fail_string = fail_flavor;
-        if (entity.traits.contains("player")) {
-            replaceSubstring(event_string, "<entity>", "You");
-            replaceSubstring(fail_string, "<entity>", "You");
-        }
-        else {
-            replaceSubstring(event_string, "<entity>", entity.name);
-            replaceSubstring(fail_string, "<entity>", entity.name);
-        }
-
-        auto& distances = effects.at("distance");
-        if (distances.contains("x") or distances.contains("y")) {
-            int x_dist = 0;
-            int y_dist = 0;
-            if (distances.contains("x")) {
-                x_dist = distances.at("x");
-            }
-            if (distances.contains("y")) {
-                y_dist = distances.at("y");
-            }
-            // Capture the distances by value, but reference the entity.
-            return [=,&entity](WorldState& ws, const vector<string>&) {
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeLinearMoveFunction() const {
+        if (MovementType::fixed == effects.movement) {
+            int x_dist = effects.distance.x;
+            int y_dist = effects.distance.y;
+            // Capture the distances by value. The entity is passed in when the command executes.
+            return [=,stamina=this->stamina,flavor=&this->flavor](Entity& entity, WorldState& ws, const vector<string>&) {
                 // Ignoring the movement arguments for now.
                 // If the entity has the stamina for the action take it, and then reduce the
                 // stamina cost from the entity's stamina if the action occurred.
                 if (stamina <= entity.stats.value().stamina) {
                     if (ws.moveEntity(entity, entity.y + y_dist, entity.x + x_dist)) {
                         entity.stats.value().stamina -= stamina;
-                        ws.logEvent({event_string, entity.y, entity.x});
+                        logFlavor(ws, *flavor, entity, 0, entity.y, entity.x);
                     }
                 }
             };
         }
-        else if (distances.contains("random_min") and distances.contains("random_max")) {
-            // Create a random generator in the given range.
-            int rand_min = distances.at("random_min");
-            int rand_max = distances.at("random_max");
+        else if (MovementType::random == effects.movement) {
+            // Move a random distance in the given range.
+            int rand_min = effects.random_min;
+            int rand_max = effects.random_max;
 
             // Lambda functions do not capture member variables, so shadow stamina with a
             // local variable.
-            return [=,&entity,stamina=this->stamina](WorldState& ws, const vector<string>&) {
+            return [=,stamina=this->stamina,flavor=&this->flavor](Entity& entity, WorldState& ws, const vector<string>&) {
                 // Ignoring the movement arguments
-                // Going to use one RNG for each lambda. This theoretically protects from
-                // some side channel shenanigans.
-                static std::mt19937 randgen{std::random_device{}()};
-                static std::uniform_int_distribution<> rand_direction(0, 1);
-                static std::uniform_int_distribution<> rand_distance(rand_min, rand_max);
+                // The numbers come from the entity's own stream so that the world can be replayed.
+                RandomStream& randgen = ws.randomStream(entity, RandomStream::Purpose::wander);
                 int y_location = entity.y;
                 int x_location = entity.x;
                 // Chose a random movement
-                if (0 == rand_direction(randgen)) {
-                    y_location += rand_distance(randgen);
+                if (0 == randgen.uniform(0, 1)) {
+                    y_location += randgen.uniform(rand_min, rand_max);
                 }
                 else {
-                    x_location += rand_distance(randgen);
+                    x_location += randgen.uniform(rand_min, rand_max);
                 }
                 // If the entity has the stamina for the action take it, and then reduce the
                 // stamina cost from the entity's stamina if the action occurred.
                 if (stamina <= entity.stats.value().stamina) {
                     if (ws.moveEntity(entity, y_location, x_location)) {
                         entity.stats.value().stamina -= stamina;
-                        ws.logEvent({event_string, entity.y, entity.x});
+                        logFlavor(ws, *flavor, entity, 0, entity.y, entity.x);
                     }
                 }
             };
@@ -581,56 +658,54 @@ namespace Behavior {
         return noop_function;
     }
 
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeMoveFunction(Entity& entity) const {
-        if (effects.contains("distance")) {
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeMoveFunction() const {
+        if (MovementType::fixed == effects.movement or MovementType::random == effects.movement) {
             // Linear movement function
-            return makeLinearMoveFunction(entity);
+            return makeLinearMoveFunction();
         }
         else {
             // Conditional movement function.
-            return makeConditionalMoveFunction(entity);
+            return makeConditionalMoveFunction();
 
         }
         // Otherwise return a nothing
         return noop_function;
     }
 
-    void informationFunction(Entity& actor, const Ability& ability, std::vector<std::string> info_types, std::string event_string, std::string fail_string, WorldState& ws, const std::vector<std::string>& arguments) {
+    void informationFunction(const Ability& ability, std::vector<std::string> info_types, Entity& actor, WorldState& ws, const std::vector<std::string>& arguments) {
         // Verify that this action can be taken.
         // TODO FIXME Should have a better way to find the minimum arguments
         size_t min_arguments = 1;
         if (ability.arguments.empty()) {
             min_arguments = 0;
         }
-        if (not actionBoilerplateCheck(actor, ws, ability, arguments, min_arguments, fail_string)) {
+        if (not actionBoilerplateCheck(actor, ws, ability, arguments, min_arguments)) {
             return;
         }
 
         // Keep track of detected entities and update them in the information section of the status
         // window.
 
-        std::vector<std::list<Entity>::iterator> targets;
-        std::set<std::tuple<size_t, size_t>> area_of_effect;
+        std::vector<EntityHandle> targets;
+        std::vector<std::tuple<size_t, size_t>> area_of_effect;
         if (AbilityArea::single == ability.area) {
-            auto [target, target_location] = findOneTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            auto [target, target_location] = findOneTarget(ws, actor, ability, arguments);
 
-            if (ws.entities.end() != target) {
+            if (target) {
                 targets.push_back(target);
             }
         }
         else if (AbilityArea::cone == ability.area) {
-            std::tie(targets, area_of_effect) = findConeTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            std::tie(targets, area_of_effect) = findConeTarget(ws, actor, ability, arguments);
         }
         else if (AbilityArea::radius == ability.area) {
-            std::tie(targets, area_of_effect) = findRadiusTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            std::tie(targets, area_of_effect) = findRadiusTarget(ws, actor, ability, arguments);
         }
 
         // Mark background colors for the area of effect
         for (auto& location : area_of_effect) {
-            if (std::get<0>(location) < ws.field_height and std::get<1>(location) < ws.field_width) {
-                // TODO Hard-coding the utility color to be cyan here.
-                ws.background_effects.insert({location, "cyan"});
-            }
+            // TODO Hard-coding the utility color to be cyan here.
+            ws.tile_effects.mark(std::get<0>(location), std::get<1>(location), TileEffect::cyan);
         }
 
         // Handle targets if there are any.
@@ -638,11 +713,13 @@ namespace Behavior {
             // Subtract the ability's stamina cost.
             actor.stats.value().stamina -= ability.stamina;
             // Handle each observed target.
-            for (auto target : targets) {
-                std::string target_event_string = event_string;
-                replaceSubstring(target_event_string, "<target>", target->name);
+            for (EntityHandle target_handle : targets) {
+                const Entity* target = ws.entities.get(target_handle);
+                if (nullptr == target) {
+                    continue;
+                }
                 // Log the success event
-                ws.logEvent({target_event_string, actor.y, actor.x});
+                logFlavor(ws, ability.flavor, actor, target->entity_id, actor.y, actor.x);
                 // Now log any observable information.
                 // Pull out traits that are observable with the given information_types.
                 std::vector<std::wstring> target_information;
@@ -660,47 +737,47 @@ namespace Behavior {
         }
         else {
             // Otherwise log the failure string
-            ws.logEvent({fail_string, actor.y, actor.x});
+            logFlavor(ws, ability.fail_flavor, actor, 0, actor.y, actor.x);
         }
     }
 
-    void equipFunction(Entity& actor, const Ability& ability, const std::string& equip_type, std::string event_string, std::string fail_string, WorldState& ws, const std::vector<std::string>& arguments) {
+    // required_trait is the trait that equipment must have, such as weapon for wield, or nullopt if
+    // any item may be equipped.
+    void equipFunction(const Ability& ability, std::optional<TraitId> required_trait, Entity& actor, WorldState& ws, const std::vector<std::string>& arguments) {
         // Verify that this action can be taken.
         // TODO FIXME Should have a better way to find the minimum arguments
         size_t min_arguments = 1;
         if (ability.arguments.empty()) {
             min_arguments = 0;
         }
-        if (not actionBoilerplateCheck(actor, ws, ability, arguments, min_arguments, fail_string)) {
+        if (not actionBoilerplateCheck(actor, ws, ability, arguments, min_arguments)) {
             return;
         }
 
         // Keep track of detected entities and update them in the information section of the status
         // window.
 
-        std::vector<std::list<Entity>::iterator> targets;
-        std::set<std::tuple<size_t, size_t>> area_of_effect;
+        std::vector<EntityHandle> targets;
+        std::vector<std::tuple<size_t, size_t>> area_of_effect;
         // TODO The search functions should also search the world states contained by inventory on the user.
         if (AbilityArea::single == ability.area) {
-            auto [target, target_location] = findOneTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            auto [target, target_location] = findOneTarget(ws, actor, ability, arguments);
 
-            if (ws.entities.end() != target) {
+            if (target) {
                 targets.push_back(target);
             }
         }
         else if (AbilityArea::cone == ability.area) {
-            std::tie(targets, area_of_effect) = findConeTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            std::tie(targets, area_of_effect) = findConeTarget(ws, actor, ability, arguments);
         }
         else if (AbilityArea::radius == ability.area) {
-            std::tie(targets, area_of_effect) = findRadiusTarget(ws, actor, ability.effects, ability.arguments, ability.default_args, arguments);
+            std::tie(targets, area_of_effect) = findRadiusTarget(ws, actor, ability, arguments);
         }
 
         // Mark background colors for the area of effect
         for (auto& location : area_of_effect) {
-            if (std::get<0>(location) < ws.field_height and std::get<1>(location) < ws.field_width) {
-                // TODO Hard-coding the utility color to be cyan here.
-                ws.background_effects.insert({location, "cyan"});
-            }
+            // TODO Hard-coding the utility color to be cyan here.
+            ws.tile_effects.mark(std::get<0>(location), std::get<1>(location), TileEffect::cyan);
         }
 
         // Handle targets if there are any.
@@ -708,7 +785,17 @@ namespace Behavior {
             // Subtract the ability's stamina cost and attempt to equip items.
             actor.stats.value().stamina -= ability.stamina;
             // Assign each item to a slot
-            for (std::list<Entity>::iterator equipment : targets) {
+            for (EntityHandle equipment_handle : targets) {
+                // An earlier iteration may have already picked this up.
+                Entity* equipment = ws.entities.get(equipment_handle);
+                if (nullptr == equipment) {
+                    continue;
+                }
+                // Items of the wrong type cannot be equipped with this ability.
+                if (required_trait and not equipment->traits.contains(required_trait.value())) {
+                    logFlavor(ws, ability.fail_flavor, actor, equipment->entity_id, actor.y, actor.x);
+                    continue;
+                }
                 // This ability affects a slot, right? Was it provided, or will it be inferred?
                 std::string target_slot = "";
                 if (2 <= arguments.size() and 2 <= ability.arguments.size() and ability.arguments.at(1) == "<slot>") {
@@ -742,185 +829,121 @@ namespace Behavior {
                     // Check if this item can be equipped
                     if (actor.possible_slots.end() != possible_slot) {
                         // Create the message for this action
-                        std::string target_event_string = event_string;
-                        replaceSubstring(target_event_string, "<target>", equipment->name);
-                        replaceSubstring(target_event_string, "<slot>", *possible_slot);
-                        // Reset equipment's current location
-                        equipment->y = 0;
-                        equipment->x = 0;
-                        // Equip and remove from the world state
+                        WorldEvent equip_event{.flavor = &ability.flavor, .actor_id = actor.entity_id,
+                            .target_id = equipment->entity_id, .slot = *possible_slot, .y = actor.y, .x = actor.x};
+                        // Remove from the world state and equip. Removal only retires the entity,
+                        // so it can still be moved out of the world state afterwards.
+                        ws.removeEntity(equipment_handle);
                         std::optional<Entity> swapped = actor.equip(*equipment, *possible_slot);
-                        ws.entities.erase(equipment);
+                        // Reset equipment's current location
+                        actor.occupied_slots.at(*possible_slot).y = 0;
+                        actor.occupied_slots.at(*possible_slot).x = 0;
                         // If we swapped equipment then this should be dropped into the same
                         // location as the actor
                         if (swapped) {
                             // Put swapped equipment into actor's location
                             swapped.value().y = actor.y;
                             swapped.value().x = actor.x;
-                            std::string drop_string = actor.name + " drops " + swapped.value().name + ".";
-                            ws.logEvent({drop_string, actor.y, actor.x});
-                            ws.entities.push_back(std::move(swapped.value()));
+                            ws.logEvent({.type = EventType::drop, .actor_id = actor.entity_id,
+                                .target_id = swapped.value().entity_id, .y = actor.y, .x = actor.x});
+                            ws.insertEntity(std::move(swapped.value()));
                         }
                         // Log the equip event.
-                        ws.logEvent({target_event_string, actor.y, actor.x});
+                        ws.logEvent(std::move(equip_event));
                     }
                     else {
                         // Otherwise log the failure string
-                        std::string target_fail_string = fail_string;
-                        replaceSubstring(target_fail_string, "<target>", equipment->name);
-                        ws.logEvent({target_fail_string, actor.y, actor.x});
+                        logFlavor(ws, ability.fail_flavor, actor, equipment->entity_id, actor.y, actor.x);
                     }
                 }
             }
         }
         else {
-            // Otherwise log the failure string
-            std::string target_fail_string = fail_string;
-            replaceSubstring(target_fail_string, "<target>", "something");
-            ws.logEvent({target_fail_string, actor.y, actor.x});
+            // Otherwise log the failure string. Without a target it renders as "something".
+            logFlavor(ws, ability.fail_flavor, actor, 0, actor.y, actor.x);
         }
     }
 
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeUtilityFunction(Entity& entity) const {
-        // Prepare a flavor string to go into the event log whenever this behavior occurs.
-        // Fill in some fields in advance.
-        std::string event_string = flavor;
-        std::string fail_string = fail_flavor;
-        // If this is the player then use "You" instead of the entity name.
-        if (entity.traits.contains("player")) {
-            replaceSubstring(event_string, "<entity>", "You");
-            replaceSubstring(fail_string, "<entity>", "You");
-        }
-        else {
-            replaceSubstring(event_string, "<entity>", entity.name);
-            replaceSubstring(fail_string, "<entity>", entity.name);
-        }
-
-
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeUtilityFunction() const {
         // See if this is an information skill
-        if (effects.contains("information")) {
-            std::vector<std::string> information_types = effects.at("information");
-
+        if (not effects.information.empty()) {
             // Information utility function.
-            return std::bind_front(informationFunction, std::ref(entity), std::cref(*this), information_types, event_string, fail_string);
+            return std::bind_front(informationFunction, std::cref(*this), effects.information);
 
         }
-        else if (effects.contains("equip")) {
-            std::string equip_type = effects.at("equip");
+        else if (effects.equip) {
+            // Equipping an "item" or a placeholder such as "<item>" accepts any item. Any other
+            // type is a trait that the item must have.
+            const std::string& equip_type = effects.equip.value();
+            std::optional<TraitId> required_trait;
+            if ("item" != equip_type and not equip_type.starts_with("<")) {
+                required_trait = Traits::intern(equip_type);
+            }
 
-            // Information utility function.
-            return std::bind_front(equipFunction, std::ref(entity), std::cref(*this), equip_type, event_string, fail_string);
+            // Equip utility function.
+            return std::bind_front(equipFunction, std::cref(*this), required_trait);
         }
         // Otherwise return a nothing
         return noop_function;
     }
 
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeAttackFunction(Entity& entity) const {
-        // Lambda functions do not capture member variables, so shadow stamina with a
-        // local variable.
-        double base = 0;
-        double strength = 0;
-        double domain = 0;
-        double aura = 0;
-        double reflexes = 0;
-        if (effects.contains("damage")) {
-            auto& damage_effects = effects.at("damage");
-            if (damage_effects.contains("base")) {
-                base = damage_effects.at("base");
-            }
-            if (damage_effects.contains("strength")) {
-                strength = damage_effects.at("strength");
-            }
-            if (damage_effects.contains("domain")) {
-                domain = damage_effects.at("domain");
-            }
-            if (damage_effects.contains("aura")) {
-                aura = damage_effects.at("aura");
-            }
-            if (damage_effects.contains("reflexes")) {
-                reflexes = damage_effects.at("reflexes");
-            }
-        }
-        // TODO Or maybe just copy over any effects that are also in the expected arguments?
-        std::vector<std::string> expected_args = arguments;
-        std::vector<std::string> default_args = this->default_args;
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeAttackFunction() const {
+        // The flavor text is rendered when the event is observed, so only its location is captured.
         // TODO Make different classes for range and area combinations
-        // Prepare a flavor string to go into the event log whenever this behavior occurs.
-        // Fill in some fields in advance.
-        std::string event_string = flavor;
-        std::string fail_string = fail_flavor;
-        // If this is the player then use "You" instead of the entity name.
-        if (entity.traits.contains("player")) {
-            replaceSubstring(event_string, "<entity>", "You");
-            replaceSubstring(fail_string, "<entity>", "You");
-        }
-        else {
-            replaceSubstring(event_string, "<entity>", entity.name);
-            replaceSubstring(fail_string, "<entity>", entity.name);
-        }
-
-        return [=,&entity,effects=this->effects,stamina=this->stamina](WorldState& ws, const vector<string>& args) {
-            size_t damage = floor(base + strength * entity.stats.value().strength + domain * entity.stats.value().domain +
-                aura * entity.stats.value().aura + reflexes * entity.stats.value().reflexes);
+        return [ability=this](Entity& entity, WorldState& ws, const vector<string>& args) {
+            const DamageEffect& growth = ability->effects.damage;
+            const Stats& stats = entity.stats.value();
+            size_t damage = floor(growth.base + growth.strength * stats.strength + growth.domain * stats.domain +
+                growth.aura * stats.aura + growth.reflexes * stats.reflexes);
             // Now parse the arguments to see what is getting hit.
-            auto [target, target_location] = findOneTarget(ws, entity, effects, expected_args, default_args, args);
-            if (target != ws.entities.end()) {
-                std::string log_string = event_string;
-                replaceSubstring(log_string, "<target>", target->name);
-                ws.logEvent({log_string, target->y, target->x});
+            auto [target, target_location] = findOneTarget(ws, entity, *ability, args);
+            if (Entity* target_entity = ws.entities.get(target)) {
+                logFlavor(ws, ability->flavor, entity, target_entity->entity_id, target_entity->y, target_entity->x);
 
                 // Deal damage to the target
                 ws.damageEntity(target, damage, entity);
             }
             else {
-                ws.logEvent({fail_string, entity.y, entity.x});
-            }
-            // Visually mark the tile if it is on the map
-            if (std::get<0>(target_location) < ws.field_height and std::get<1>(target_location) < ws.field_width) {
-                // TODO Hard-coding the attack color to be red here.
-                ws.background_effects.insert({target_location, "red"});
+                logFlavor(ws, ability->fail_flavor, entity, 0, entity.y, entity.x);
             }
+            // Visually mark the tile. Tiles that are not on the map are ignored.
+            // TODO Hard-coding the attack color to be red here.
+            ws.tile_effects.mark(std::get<0>(target_location), std::get<1>(target_location), TileEffect::red);
             // The attack always consumes stamina
-            entity.stats.value().stamina -= stamina;
+            entity.stats.value().stamina -= ability->stamina;
         };
         // Otherwise return a nothing
         return noop_function;
     }
 
-    // Make a function for the specific entity.
-    std::function<void(WorldState&, const std::vector<std::string>&)> Ability::makeFunction(Entity& entity) const {
+    // Make the function for this ability.
+    std::function<void(Entity&, WorldState&, const std::vector<std::string>&)> Ability::makeFunction() const {
         if (type == AbilityType::movement) {
-            return makeMoveFunction(entity);
+            return makeMoveFunction();
         }
         else if (type == AbilityType::attack) {
-            return makeAttackFunction(entity);
+            return makeAttackFunction();
         }
         else if (type == AbilityType::utility) {
-            return makeUtilityFunction(entity);
+            return makeUtilityFunction();
         }
         // Otherwise return a nothing
         return noop_function;
     }
 
+    void Ability::execute(Entity& actor, WorldState& ws, const std::vector<std::string>& arguments) const {
+        function(actor, ws, arguments);
+    }
+
     // Find the ability names that are available to this entity within this behavior set.
     std::vector<std::string> AbilitySet::getAvailable(const Entity& entity) const {
         // TODO Check if ability set should be available
         std::vector<std::string> available;
 
         for (auto& [ability_name, ability] : abilities) {
-            bool can_use = true;
             // TODO prereqs
             // Verify that the entity satisfies all constraints
-            if (0 < ability.constraints.size()) {
-                if ("or" == ability.constraints.front()) {
-                    can_use = can_use and std::any_of(ability.constraints.begin()+1, ability.constraints.end(),
-                        [&](const std::string& constraint) {return entity.traits.contains(constraint);});
-                }
-                else {
-                    can_use = can_use and std::all_of(ability.constraints.begin(), ability.constraints.end(),
-                        [&](const std::string& constraint) {return entity.traits.contains(constraint);});
-                }
-            }
+            bool can_use = ability.meetsConstraints(entity.traits);
             if (can_use) {
                 available.push_back(ability_name);
             }
@@ -930,34 +953,23 @@ namespace Behavior {
 
     // Update abilities from this set that are available to an entity. Return new abilities.
     std::vector<std::string> AbilitySet::updateAvailable(Entity& entity) const {
+        static const Opcode attack_opcode = Commands::intern("attack");
         std::vector<std::string> available;
 
         // Check which abilities this entity should be able to use.
         for (auto& [ability_name, ability] : abilities) {
-            bool can_use = true;
             // TODO prereqs
             // Verify that the entity satisfies all constraints
-            if (0 < ability.constraints.size()) {
-                if ("or" == ability.constraints.front()) {
-                    can_use = can_use and std::any_of(ability.constraints.begin()+1, ability.constraints.end(),
-                        [&](const std::string& constraint) {return entity.traits.contains(constraint);});
-                }
-                else {
-                    can_use = can_use and std::all_of(ability.constraints.begin(), ability.constraints.end(),
-                        [&](const std::string& constraint) {return entity.traits.contains(constraint);});
-                }
-            }
+            bool can_use = ability.meetsConstraints(entity.traits);
             if (can_use) {
-                entity.command_handlers.insert({ability_name, makeFunction(ability_name, entity)});
-                entity.command_details.insert({ability_name, ability});
+                entity.command_handlers.insert(ability.opcode, &ability);
                 available.push_back(ability_name);
 
                 // Automatically alias "attack" to the strongest single stamina attack available.
                 if (AbilityType::attack == ability.type) {
                     // TODO The strongest attack type
                     available.push_back("attack");
-                    entity.command_handlers.insert({"attack", entity.command_handlers.at(ability_name)});
-                    entity.command_details.insert({"attack", entity.command_details.at(ability_name)});
+                    entity.command_handlers.insert(attack_opcode, &ability);
                 }
             }
         }
@@ -965,15 +977,6 @@ namespace Behavior {
         return available;
     }
 
-
-    std::function<void(WorldState&, const std::vector<std::string>&)> AbilitySet::makeFunction(const std::string& ability, Entity& entity) const {
-        // Make the function for this ability.
-        if (not abilities.contains(ability)) {
-            return noop_function;
-        }
-        return abilities.at(ability).makeFunction(entity);
-    }
-
     const std::vector<AbilitySet>& getAbilities() {
         if (0 < loaded_abilities.size()) {
             return loaded_abilities;
@@ -984,6 +987,8 @@ namespace Behavior {
         for (auto& [ability_name, ability_json] : abilities.get<std::map<std::string, json>>()) {
             loaded_abilities.push_back(AbilitySet(ability_name, ability_json));
         }
+        // Attack abilities are also available through the attack alias (see updateAvailable).
+        Commands::intern("attack");
         return loaded_abilities;
     }
 
@@ -991,130 +996,192 @@ namespace Behavior {
         if (0 < loaded_behaviors.size()) {
             return loaded_behaviors;
         }
+        // Load the abilities first so that rules can abbreviate their names.
+        getAbilities();
         // Otherwise we need to load the json file and populate the behaviors.
         json behaviors = loadJson("resources/behavior_set.json");
         // Go through the json and translate all of the entries into new BehaviorSets.
         for (auto& [behavior_name, behavior_json] : behaviors.get<std::map<std::string, json>>()) {
-            std::string description = behavior_json.at("description").get<std::string>();
-            std::vector<std::vector<std::string>> rules;
-            behavior_json.at("rules").get_to(rules);
-            loaded_behaviors.insert({behavior_name, {behavior_name, description, rules}});
+            loaded_behaviors.insert({behavior_name, BehaviorSet(behavior_name, behavior_json)});
         }
         return loaded_behaviors;
     }
 
-    std::function<bool(double, double)> strToCompFn(const std::string& str) {
+    Comparison stoComparison(const std::string& str) {
         if ("<" == str) {
-            return std::less<double>{};
+            return Comparison::less;
         }
         else if (">" == str) {
-            return std::greater<double>{};
+            return Comparison::greater;
         }
         else if ("<=" == str) {
-            return std::less_equal<double>{};
+            return Comparison::less_equal;
         }
         else if (">=" == str) {
-            return std::greater_equal<double>{};
+            return Comparison::greater_equal;
         }
         else if ("!=" == str) {
-            return std::not_equal_to<double>{};
+            return Comparison::not_equal;
         }
         else if ("==" == str) {
-            return std::equal_to<double>{};
+            return Comparison::equal;
         }
-        // Return an empty function if there was no match.
-        return [](double, double) { return false; };
+        throw std::runtime_error("Unknown comparison " + str);
     }
 
-    void BehaviorSet::executeBehavior(Entity& entity, WorldState& ws, CommandHandler& comham) const{
-        // Go through the behavior set of the given entity and follow its rules to take appropriate
-        // actions.
-        const std::regex hp_condition("hp ([<>]) ([0-9]+)%");
-        const std::regex distance_condition("distance:([a-z]+) ([<>]) ([0-9]+)");
+    bool compare(Comparison comparison, double a, double b) {
+        switch (comparison) {
+            case Comparison::less:
+                return a < b;
+            case Comparison::greater:
+                return a > b;
+            case Comparison::less_equal:
+                return a <= b;
+            case Comparison::greater_equal:
+                return a >= b;
+            case Comparison::not_equal:
+                return a != b;
+            case Comparison::equal:
+                return a == b;
+        }
+        return false;
+    }
+
+    // Parse the text of a rule condition.
+    Condition parseCondition(const std::string& rule) {
+        const std::regex hp_condition("hp (<|>|<=|>=|!=|==) ([0-9]+)%");
+        const std::regex distance_condition("distance:([a-z]+) (<|>|<=|>=|!=|==) ([0-9]+)");
         const std::regex detect_condition("sense ([a-z]+)");
-        const std::regex else_condition("else");
 
+        Condition condition;
         std::smatch matches;
-        // Check entity.behavior_set_name to ensure that the entity has a valid behavior pattern.
-        if (loaded_behaviors.contains(entity.behavior_set_name)) {
-            // Need to remember if any actions were taken when we reach any "else" rule conditions.
-            bool any_action_taken = false;
-
-            // TODO FIXME These could be preprocessed once when the BehaviorSet is constructed
-            // instead of being reprocessed every time the behavior is executed.
-            const BehaviorSet& bset = loaded_behaviors.at(entity.behavior_set_name);
-            for (const std::vector<std::string>& rule_actions : bset.rules) {
-                bool do_actions = false;
-                const std::string& rule = rule_actions.at(0);
-                // Check if this rule is a hit point condition
-                if (std::regex_match(rule, matches, hp_condition)) {
-                    std::string comparison = matches[1].str();
-                    // Read the threshold and convert from percent.
-                    double threshold = stod(matches[2].str())/100.0;
+        if (std::regex_match(rule, matches, hp_condition)) {
+            condition.type = ConditionType::hp;
+            condition.comparison = stoComparison(matches[1].str());
+            // Read the threshold and convert from percent.
+            condition.threshold = stod(matches[2].str())/100.0;
+        }
+        else if (std::regex_match(rule, matches, distance_condition)) {
+            condition.type = ConditionType::distance;
+            condition.target_name = matches[1].str();
+            condition.comparison = stoComparison(matches[2].str());
+            condition.range = stoull(matches[3].str());
+        }
+        else if (std::regex_match(rule, matches, detect_condition)) {
+            condition.type = ConditionType::sense;
+            condition.target_name = matches[1].str();
+        }
+        else if ("else" == rule) {
+            condition.type = ConditionType::otherwise;
+        }
+        else {
+            throw std::runtime_error("Unknown behavior rule condition: " + rule);
+        }
+        // Intern the target so that trait searches for it work for entities created after loading.
+        if (not condition.target_name.empty()) {
+            Traits::intern(condition.target_name);
+            condition.target_traits = TraitQuery(std::vector<std::string>{condition.target_name});
+        }
+        return condition;
+    }
+
+    BehaviorSet::BehaviorSet(const std::string& name, nlohmann::json& behavior_json) {
+        this->name = name;
+        description = behavior_json.at("description").get<std::string>();
+        std::vector<std::vector<std::string>> rule_strings;
+        behavior_json.at("rules").get_to(rule_strings);
+        for (const std::vector<std::string>& rule_actions : rule_strings) {
+            if (rule_actions.empty()) {
+                throw std::runtime_error("Empty rule in behavior set " + name);
+            }
+            Rule rule{parseCondition(rule_actions.at(0)), {}};
+            // Actions are everything in rule_actions from index 1 onward.
+            for (size_t idx = 1; idx < rule_actions.size(); ++idx) {
+                Action action;
+                ParsedCommand parsed = parseCommand(rule_actions.at(idx));
+                action.repetitions = parsed.repetitions;
+                action.arguments.assign(parsed.arguments.begin(), parsed.arguments.end());
+                // Rules may abbreviate ability names, just as the player can. Only abilities can be
+                // performed, so any other action would do nothing. It is skipped rather than
+                // interned so that it does not lengthen the abbreviations of real commands.
+                if (not Commands::resolve(parsed.command, action.command)) {
+                    std::cerr<<"Skipping unknown or ambiguous command "<<parsed.command<<
+                        " in behavior set "<<name<<'\n';
+                    continue;
+                }
+                rule.actions.push_back(std::move(action));
+            }
+            rules.push_back(std::move(rule));
+        }
+    }
+
+    // Find the target of a condition within range, first as a trait and then as a name.
+    const Entity* findConditionTarget(const Condition& condition, const Entity& entity, WorldState& ws, size_t range) {
+        const Entity* target = ws.entities.get(ws.perceiveTraits(condition.target_traits, entity.y, entity.x, range));
+        if (nullptr == target) {
+            target = ws.entities.get(ws.perceiveName(condition.target_name, entity.y, entity.x, range));
+        }
+        return target;
+    }
+
+    void BehaviorSet::executeBehavior(const Entity& entity, WorldState& ws, CommandBuffer& buffer) const{
+        // Go through the behavior set of the given entity and follow its rules to take appropriate
+        // actions.
+        // Need to remember if any actions were taken when we reach any "else" rule conditions.
+        bool any_action_taken = false;
+        EntityHandle handle;
+        for (const Rule& rule : rules) {
+            const Condition& condition = rule.condition;
+            bool do_actions = false;
+            switch (condition.type) {
+                case ConditionType::hp:
                     if (entity.stats) {
-                        Stats& stats = entity.stats.value();
+                        const Stats& stats = entity.stats.value();
                         double hp_percent = (double)stats.health / stats.maxHealth();
-                        auto comp_fn = strToCompFn(comparison);
                         // Take the actions if the comparison is true.
-                        do_actions = comp_fn(hp_percent, threshold);
+                        do_actions = compare(condition.comparison, hp_percent, condition.threshold);
                     }
-                }
-                // Check if this rule is a distance condition
-                else if (std::regex_match(rule, matches, distance_condition)) {
-                    // Unpack the values from the match
-                    std::string target = matches[1].str();
-                    auto comp_fn = strToCompFn(matches[2].str());
-                    size_t range = stoull(matches[3].str());
-                    // An entity cannot sense anything beyond its detection range.
-                    if (entity.stats) {
-                        range = std::min(range, entity.stats.value().detectionRange());
-                    }
-                    // Assume that the target is a trait and search for it.
-                    auto target_entity_i = ws.findEntity(std::vector<std::string>{target}, entity.y, entity.x, range);
-                    // If that didn't match, then search via a name
-                    if (ws.entities.end() == target_entity_i) {
-                        target_entity_i = ws.findEntity(target, entity.y, entity.x, range);
-                    }
-
-                    // Now check the distance threshold if the target entity was found.
-                    if (ws.entities.end() != target_entity_i) {
-                        size_t distance = std::abs((int)entity.y - (int)target_entity_i->y) +
-                                          std::abs((int)entity.x - (int)target_entity_i->x);
-                        do_actions = comp_fn(distance, range);
+                    break;
+                case ConditionType::distance:
+                    {
+                        size_t range = condition.range;
+                        // An entity cannot sense anything beyond its detection range.
+                        if (entity.stats) {
+                            range = std::min(range, entity.stats.value().detectionRange());
+                        }
+                        const Entity* target = findConditionTarget(condition, entity, ws, range);
+                        // Now check the distance threshold if the target entity was found.
+                        if (nullptr != target) {
+                            size_t distance = std::abs((int)entity.y - (int)target->y) +
+                                              std::abs((int)entity.x - (int)target->x);
+                            do_actions = compare(condition.comparison, distance, range);
+                        }
                     }
-                }
-                // Check if this rule is a detection condition
-                if (std::regex_match(rule, matches, detect_condition)) {
-                    // Unpack the values from the match
-                    std::string target = matches[1].str();
+                    break;
+                case ConditionType::sense:
                     // Check if this entity has a detection range.
                     if (entity.stats) {
-                        size_t range =  entity.stats.value().detectionRange();
-                        // Assume that the target is a trait and search for it.
-                        auto target_entity_i = ws.findEntity(std::vector<std::string>{target}, entity.y, entity.x, range);
-                        // If that didn't match, then search via a name
-                        if (ws.entities.end() == target_entity_i) {
-                            target_entity_i = ws.findEntity(target, entity.y, entity.x, range);
-                        }
+                        size_t range = entity.stats.value().detectionRange();
                         // If the entity was detected then do the actions.
-                        do_actions = ws.entities.end() != target_entity_i;
+                        do_actions = nullptr != findConditionTarget(condition, entity, ws, range);
                     }
-                }
-                // Check if this rule is an else condition.
-                if (std::regex_match(rule, matches, else_condition)) {
+                    break;
+                case ConditionType::otherwise:
                     // Take the else actions if no other actions were taken.
                     do_actions = not any_action_taken;
+                    break;
+            }
+            any_action_taken = any_action_taken or do_actions;
+            if (do_actions) {
+                if (not handle) {
+                    handle = ws.entities.handleOf(entity);
                 }
-                any_action_taken = any_action_taken or do_actions;
-                if (do_actions) {
-                    // Put the actions into the command handler.
-                    // Actions are everything in rule_actions from index 1 onward.
-                    for (size_t idx = 1; idx < rule_actions.size(); ++idx) {
-                        //TODO it would be nice if we got world state changes in between
-                        //actions.
-                        //Easy enough to craft the AI rules around this limitation though.
-                        comham.enqueueEntityCommand(entity, rule_actions.at(idx));
-                    }
+                // Put the actions into the command handler.
+                for (const Action& action : rule.actions) {
+                    //TODO it would be nice if we got world state changes in between
+                    //actions.
+                    //Easy enough to craft the AI rules around this limitation though.
+                    buffer.enqueueEntityRefCommand(entity, handle, action.command, action.arguments, action.repetitions);
                 }
             }
         }
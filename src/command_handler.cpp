@@ -7,11 +7,11 @@
  */
 
 #include <algorithm>
-#include <cctype>
-#include <functional>
-#include <unordered_map>
-#include <set>
+#include <charconv>
+#include <limits>
+#include <utility>
 #include <string>
+#include <tuple>
 #include <vector>
 
 using std::string;
@@ -19,173 +19,295 @@ using std::vector;
 
 #include "command_handler.hpp"
 #include "entity.hpp"
+#include "trait_set.hpp"
 #include "world_state.hpp"
 
-// Where we can find all of the handlers
-std::unordered_map<std::string, std::function<void(Entity&, WorldState&, const vector<string>&)>> command_handlers{
-};
-
-// Go through all of the command handlers, take the keys, and insert any non-overlapping
-// abbreviations.
-void createAbbreviations(decltype(command_handlers)& handlers) {
-    std::vector<string> keys;
-    for (const auto& [key, value] : handlers) {
-        keys.push_back(key);
-    }
-
-    // Resolve all keys first before trying to resolve any name collisions.
-    std::set<string> collisions;
-    for (const std::string& key : keys) {
-        // Insert entries for everything from key.substr(0, 1) to key.substr(0, key.size()-1)
-        // If there is ever a collision then add this to the collision list and remove them at the
-        // end.
-        for (size_t sublen = 1; sublen < key.size(); ++sublen) {
-            string substr = key.substr(0, sublen);
-            if (handlers.contains(substr)) {
-                collisions.insert(substr);
-            }
-            else {
-                command_handlers.insert(std::make_pair(substr, command_handlers[key]));
-            }
+ParsedCommand parseCommand(std::string_view text) {
+    ParsedCommand parsed;
+    std::vector<std::string_view> tokens;
+    for (size_t start = 0; start < text.size();) {
+        size_t end = std::min(text.find(' ', start), text.size());
+        if (start < end) {
+            tokens.push_back(text.substr(start, end - start));
         }
+        start = end + 1;
     }
+    if (tokens.empty()) {
+        return parsed;
+    }
+    // A leading number followed by a command is the repetition count.
+    size_t first = 0;
+    if (1 < tokens.size()) {
+        std::string_view count = tokens.front();
+        size_t reps = 0;
+        auto [end, error] = std::from_chars(count.data(), count.data() + count.size(), reps);
+        if (std::errc() == error and count.data() + count.size() == end) {
+            parsed.repetitions = reps;
+            first = 1;
+        }
+    }
+    parsed.command = tokens.at(first);
+    parsed.arguments.assign(tokens.begin() + first + 1, tokens.end());
+    return parsed;
+}
 
-    std::erase_if(command_handlers, [&](const auto& item) {
-        auto const& [key, value] = item;
-        return collisions.contains(key);
-    });
+void CommandHandler::push(std::atomic<Submission*>& list, Submission* submission) {
+    // Release ordering makes the contents of the submission visible to the thread that takes it.
+    submission->next = list.load(std::memory_order_relaxed);
+    while (not list.compare_exchange_weak(submission->next, submission,
+        std::memory_order_release, std::memory_order_relaxed)) {
+    }
 }
 
-CommandHandler::CommandHandler() {
-    createAbbreviations(command_handlers);
+void CommandHandler::takeSubmissions() {
+    Submission* newest = submissions.exchange(nullptr, std::memory_order_acquire);
+    // The list is newest first, so reverse it to queue the commands in the order they came.
+    Submission* oldest = nullptr;
+    while (nullptr != newest) {
+        Submission* next = newest->next;
+        newest->next = oldest;
+        oldest = newest;
+        newest = next;
+    }
+    for (Submission* submission = oldest; nullptr != submission; submission = submission->next) {
+        taken.push_back(submission);
+        if (not submission->entity_name.empty()) {
+            named_entity_commands.push_back({&submission->entity_name, submission->command,
+                &submission->arguments, submission->repetitions});
+        }
+        else if (not submission->traits.empty()) {
+            trait_commands.push_back({&submission->traits, submission->command,
+                &submission->arguments, submission->repetitions});
+        }
+        else {
+            entity_commands.push_back({submission->entity, submission->command,
+                &submission->arguments, submission->repetitions});
+        }
+    }
 }
 
-/*
- * Split the repitition part of the string from the @command. The returned value is the number of
- * times to repeat the command string.
- */
-size_t parseRepititions(string& command) {
-    std::string::size_type split_pos = command.find(' ') ;
-    if (string::npos != split_pos) {
-        string first_part = command.substr(0, split_pos);
-        if (std::all_of(first_part.begin(), first_part.end(), isdigit)) {
-            size_t reps = std::stoul(first_part);
-            command = command.substr(split_pos+1);
-            return reps;
-        }
-    }
-    // Otherwise the command doesn't have a numeric modifier so perform it once.
-    return 1;
+CommandHandler::Producer& CommandHandler::addProducer() {
+    std::lock_guard<std::mutex> lock(producers_mutex);
+    return producers.emplace_back(*this);
 }
 
-std::vector<string> parseArguments(string& command) {
-    std::string::size_type space_idx = command.find(' ');
-    std::vector<string> arguments;
-    if (std::string::npos != space_idx) {
-        string command_part = command.substr(0, space_idx);
-        while (std::string::npos != space_idx) {
-            std::string::size_type next_idx = command.find(' ', space_idx+1);
-            std::string next_argument = command.substr(space_idx+1, next_idx-space_idx-1);
-            if (" " != next_argument) {
-                arguments.push_back(next_argument);
-            }
-            space_idx = next_idx;
+CommandHandler::Producer::Producer(CommandHandler& handler) : handler(handler) {
+}
+
+CommandHandler::Submission& CommandHandler::Producer::obtain() {
+    if (available.empty()) {
+        // Take back every submission that the simulation thread has finished with.
+        Submission* submission = returned.exchange(nullptr, std::memory_order_acquire);
+        while (nullptr != submission) {
+            available.push_back(submission);
+            submission = submission->next;
         }
-        command = command_part;
     }
-    return arguments;
+    if (available.empty()) {
+        Submission& submission = storage.emplace_back();
+        submission.owner = this;
+        return submission;
+    }
+    Submission& submission = *available.back();
+    available.pop_back();
+    submission.entity_name.clear();
+    submission.traits.clear();
+    submission.entity = {};
+    return submission;
 }
 
-// A command for a specific entity
-void CommandHandler::enqueueNamedEntityCommand(const std::string& entity, const std::string& command) {
-    string new_command = command;
-    size_t reps = parseRepititions(new_command);
+CommandHandler::Submission* CommandHandler::Producer::parse(const std::string& command) {
+    ParsedCommand parsed = parseCommand(command);
+    Opcode opcode = 0;
+    if (0 == parsed.repetitions or not Commands::resolve(parsed.command, opcode)) {
+        return nullptr;
+    }
+    Submission& submission = obtain();
+    submission.command = opcode;
+    submission.repetitions = parsed.repetitions;
+    // Assigning into the existing strings reuses their storage.
+    submission.arguments.resize(parsed.arguments.size());
+    for (size_t idx = 0; idx < parsed.arguments.size(); ++idx) {
+        submission.arguments[idx].assign(parsed.arguments[idx]);
+    }
+    return &submission;
+}
 
-    // Now split off the arguments
-    std::vector<string> arguments = parseArguments(new_command);
-    for (size_t i = 0; i < reps; ++i) {
-        named_entity_commands.push_back({entity, new_command, arguments});
+// A command for a specific entity
+void CommandHandler::Producer::enqueueNamedEntityCommand(const std::string& entity, const std::string& command) {
+    if (entity.empty()) {
+        return;
+    }
+    if (Submission* submission = parse(command)) {
+        submission->entity_name.assign(entity);
+        push(handler.submissions, submission);
     }
 }
 
 // A command for all entities with the given trait
-void CommandHandler::enqueueTraitCommand(const std::vector<std::string>& traits, const std::string& command) {
-    string new_command = command;
-    size_t reps = parseRepititions(new_command);
-
-    // Now split off the arguments
-    std::vector<string> arguments = parseArguments(new_command);
-    for (size_t i = 0; i < reps; ++i) {
-        trait_commands.push_back({traits, new_command, arguments});
+void CommandHandler::Producer::enqueueTraitCommand(const std::vector<std::string>& traits, const std::string& command) {
+    if (traits.empty()) {
+        return;
+    }
+    if (Submission* submission = parse(command)) {
+        submission->traits.assign(traits.begin(), traits.end());
+        push(handler.submissions, submission);
     }
 }
 
-void CommandHandler::enqueueEntityRefCommand(decltype(WorldState::entities)::iterator entity_i, const std::string& command) {
-    string new_command = command;
-    size_t reps = parseRepititions(new_command);
+void CommandHandler::Producer::enqueueEntityRefCommand(EntityHandle entity, const std::string& command) {
+    if (Submission* submission = parse(command)) {
+        // Handles are safe to store since they stop resolving if the entity is removed.
+        submission->entity = entity;
+        push(handler.submissions, submission);
+    }
+}
 
-    // Now split off the arguments
-    std::vector<string> arguments = parseArguments(new_command);
-    for (size_t i = 0; i < reps; ++i) {
-        // It's too dangerous to store iterators to a container that this class has no control over,
-        // so store the entity IDs instead.
-        entity_commands.push_back({entity_i->entity_id, new_command, arguments});
+void CommandHandler::Producer::enqueueEntityRefCommand(EntityHandle entity, Opcode command,
+    std::vector<std::string>&& arguments, size_t repetitions) {
+    if (0 == repetitions) {
+        return;
     }
+    Submission& submission = obtain();
+    submission.entity = entity;
+    submission.command = command;
+    submission.arguments = std::move(arguments);
+    submission.repetitions = repetitions;
+    push(handler.submissions, &submission);
 }
 
-void CommandHandler::enqueueEntityCommand(const Entity& entity, const std::string& command) {
-    string new_command = command;
-    size_t reps = parseRepititions(new_command);
+void CommandBuffer::enqueueEntityRefCommand(const Entity& entity, EntityHandle handle, Opcode command,
+    const std::vector<std::string>& arguments, size_t repetitions) {
+    entries.push_back({entity.entity_id, handle, command, &arguments, repetitions});
+}
 
-    // Now split off the arguments
-    std::vector<string> arguments = parseArguments(new_command);
-    for (size_t i = 0; i < reps; ++i) {
-        entity_commands.push_back({entity.entity_id, new_command, arguments});
+void CommandHandler::enqueueBuffers(std::vector<CommandBuffer>& buffers) {
+    std::vector<CommandBuffer::Entry*> entries;
+    for (CommandBuffer& buffer : buffers) {
+        for (CommandBuffer::Entry& entry : buffer.entries) {
+            entries.push_back(&entry);
+        }
+    }
+    // Each entity's commands come from a single buffer, so a stable sort keeps them in order.
+    std::stable_sort(entries.begin(), entries.end(),
+        [](const CommandBuffer::Entry* a, const CommandBuffer::Entry* b) {return a->entity_id < b->entity_id;});
+    for (CommandBuffer::Entry* entry : entries) {
+        if (0 < entry->repetitions) {
+            entity_commands.push_back({entry->entity, entry->command, entry->arguments, entry->repetitions});
+        }
+    }
+    for (CommandBuffer& buffer : buffers) {
+        buffer.entries.clear();
     }
 }
 
-// Execute all enqueued commands. Entity commands will always occur before trait commands.
+uint64_t CommandHandler::initiativeDelay(const WorldState& ws, EntityHandle handle) {
+    const Entity* entity = ws.entities.get(handle);
+    size_t reflexes = (nullptr != entity and entity->stats) ? entity->stats.value().reflexes : 0;
+    return round_length / (1 + reflexes);
+}
+
+// Execute all enqueued commands in initiative order.
 void CommandHandler::executeCommands(WorldState& ws) {
+    // Take the commands submitted since the last tick. Commands submitted after this point wait
+    // for the next tick.
+    takeSubmissions();
+
     // First handle commands to entity names and traits by putting them into the regular
-    // entity_commands queue. Sort the queue by reflex speed, and then take all actions.
+    // entity_commands queue, and then take all actions in initiative order.
 
     // Handle all {name, command} pairs if they both exist
-    for (const auto& [entity_name, command, arguments] : named_entity_commands) {
-        auto entity_i = ws.findEntity(entity_name);
-        if (entity_i != ws.entities.end() and entity_i->command_handlers.contains(command)) {
-            //entity_i->command_handlers.at(command)(ws, arguments);
-            entity_commands.push_back({entity_i->entity_id, command, arguments});
+    for (const auto& [entity_name, command, arguments, repetitions] : named_entity_commands) {
+        EntityHandle handle = ws.findEntity(*entity_name);
+        Entity* entity = ws.entities.get(handle);
+        if (nullptr != entity and entity->command_handlers.contains(command)) {
+            entity_commands.push_back({handle, command, arguments, repetitions});
         }
     }
     named_entity_commands.clear();
 
     // Handle all {traits, command} pairs if we can find entities with matching traits.
-    for (const auto& [entity_traits, command, arguments] : trait_commands) {
+    for (const auto& [entity_traits, command, arguments, repetitions] : trait_commands) {
         // Find any entities with all matching traits
-        for (Entity& entity : ws.entities) {
-            if (std::all_of(entity_traits.begin(), entity_traits.end(),
-                [&](const std::string& trait) { return entity.traits.contains(trait);})) {
-                // This entity has all of the necessary traits, so execute the command if it is
-                // supported.
-                if (entity.command_handlers.contains(command)) {
-                    //entity.command_handlers.at(command)(ws, arguments);
-                    entity_commands.push_back({entity.entity_id, command, arguments});
-                }
+        for (EntityHandle handle : ws.findAllEntities(*entity_traits)) {
+            // This entity has all of the necessary traits, so execute the command if it is
+            // supported.
+            if (ws.entities.at(handle).command_handlers.contains(command)) {
+                entity_commands.push_back({handle, command, arguments, repetitions});
             }
         }
     }
     trait_commands.clear();
 
-    // TODO Sort commands by reflexes
-    // TODO Sort commands by reflexes, but successive commands by the same entity happen later in
-    // the round.
+    // Chain together the commands of each entity, keeping their order. Only the next command of
+    // each entity is in the heap, so the heap stays as small as the number of acting entities.
+    // Handles are grouped by slot. Commands for entities that no longer exist are dropped first,
+    // since a stale handle could share a slot with a live entity. Slots are not reused until the
+    // next update, so every remaining handle in a group refers to the same entity.
+    constexpr size_t no_command = std::numeric_limits<size_t>::max();
+    following.assign(entity_commands.size(), no_command);
+    turns.clear();
+    for (size_t idx = 0; idx < entity_commands.size(); ++idx) {
+        if (not ws.entities.contains(std::get<0>(entity_commands[idx]))) {
+            continue;
+        }
+        uint32_t slot = std::get<0>(entity_commands[idx]).slot;
+        if (slot_turns.size() <= slot) {
+            slot_turns.resize(slot + 1, no_command);
+        }
+        if (no_command == slot_turns[slot]) {
+            slot_turns[slot] = turns.size();
+            turns.push_back({0, 0, turns.size(), idx, idx, std::get<3>(entity_commands[idx])});
+        }
+        else {
+            Turn& turn = turns[slot_turns[slot]];
+            following[turn.last] = idx;
+            turn.last = idx;
+        }
+    }
+    for (Turn& turn : turns) {
+        slot_turns[std::get<0>(entity_commands[turn.command]).slot] = no_command;
+        turn.delay = initiativeDelay(ws, std::get<0>(entity_commands[turn.command]));
+    }
+
+    auto later = [](const Turn& a, const Turn& b) {
+        return std::tie(a.initiative, a.delay, a.order) > std::tie(b.initiative, b.delay, b.order);
+    };
+    std::make_heap(turns.begin(), turns.end(), later);
+    while (not turns.empty()) {
+        std::pop_heap(turns.begin(), turns.end(), later);
+        Turn& turn = turns.back();
 
-    // Handle all {entity iterator, command, arguments}
-    for (const auto& [entity_id, command, arguments] : entity_commands) {
-        auto entity_i = ws.findEntity(entity_id);
-        if (entity_i != ws.entities.end() and entity_i->command_handlers.contains(command)) {
-            entity_i->command_handlers.at(command)(ws, arguments);
+        auto& [handle, command, arguments, repetitions] = entity_commands[turn.command];
+        // Entities removed by earlier commands will no longer resolve.
+        Entity* entity = ws.entities.get(handle);
+        if (nullptr != entity) {
+            if (const Behavior::Ability* ability = entity->command_handlers.find(command)) {
+                ability->execute(*entity, ws, *arguments);
+            }
+        }
+        // Schedule the entity's next command, which may be another repetition of this one. Its
+        // reflexes may have changed during this command.
+        turn.remaining -= 1;
+        if (0 == turn.remaining) {
+            turn.command = following[turn.command];
+            if (no_command != turn.command) {
+                turn.remaining = std::get<3>(entity_commands[turn.command]);
+            }
+        }
+        if (no_command == turn.command) {
+            turns.pop_back();
+        }
+        else {
+            turn.delay = initiativeDelay(ws, std::get<0>(entity_commands[turn.command]));
+            turn.initiative += turn.delay;
+            std::push_heap(turns.begin(), turns.end(), later);
         }
     }
     entity_commands.clear();
+    // The commands have executed, so their submissions can be reused.
+    for (Submission* submission : taken) {
+        push(submission->owner->returned, submission);
+    }
+    taken.clear();
 }
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Interned command names. Every command name is assigned a small integer opcode when abilities are
+ * loaded, so queued commands carry an opcode instead of a string and each entity finds the ability
+ * for a command with an array index.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "command_table.hpp"
+
+namespace {
+    // Allows names to be found with a string_view without making a string.
+    struct NameHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view name) const {
+            return std::hash<std::string_view>{}(name);
+        }
+    };
+
+    // A node in the prefix trie of command names. Each node is a prefix of one or more names.
+    struct PrefixNode {
+        // Child nodes by their next character, sorted by character.
+        std::vector<std::pair<char, uint32_t>> children;
+        // The number of command names that begin with this prefix.
+        size_t names = 0;
+        // A command with this prefix, which is the only one when names is 1.
+        Opcode any = 0;
+        // True if this prefix is a whole command name, in which case exact is its opcode.
+        bool whole = false;
+        Opcode exact = 0;
+    };
+
+    struct CommandRegistry {
+        std::vector<std::string> names;
+        std::unordered_map<std::string, Opcode, NameHash, std::equal_to<>> opcodes;
+        // The prefix trie. The first node is the empty prefix.
+        std::vector<PrefixNode> prefixes{1};
+
+        void addPrefixes(const std::string& name, Opcode opcode) {
+            uint32_t node = 0;
+            for (char c : name) {
+                std::vector<std::pair<char, uint32_t>>& children = prefixes[node].children;
+                auto child = std::lower_bound(children.begin(), children.end(), std::make_pair(c, uint32_t{0}));
+                if (child == children.end() or child->first != c) {
+                    uint32_t next = prefixes.size();
+                    children.insert(child, {c, next});
+                    // Inserting may reallocate the node storage, so children is not used after this.
+                    prefixes.emplace_back();
+                    node = next;
+                }
+                else {
+                    node = child->second;
+                }
+                prefixes[node].names += 1;
+                prefixes[node].any = opcode;
+            }
+            prefixes[node].whole = true;
+            prefixes[node].exact = opcode;
+        }
+    };
+
+    CommandRegistry& registry() {
+        static CommandRegistry commands;
+        return commands;
+    }
+}
+
+Opcode Commands::intern(const std::string& command) {
+    CommandRegistry& commands = registry();
+    auto [location, inserted] = commands.opcodes.insert({command, commands.names.size()});
+    if (inserted) {
+        commands.names.push_back(command);
+        commands.addPrefixes(command, location->second);
+    }
+    return location->second;
+}
+
+bool Commands::resolve(std::string_view command, Opcode& opcode) {
+    const CommandRegistry& commands = registry();
+    if (command.empty()) {
+        return false;
+    }
+    uint32_t node = 0;
+    for (char c : command) {
+        const std::vector<std::pair<char, uint32_t>>& children = commands.prefixes[node].children;
+        auto child = std::lower_bound(children.begin(), children.end(), std::make_pair(c, uint32_t{0}));
+        if (child == children.end() or child->first != c) {
+            return false;
+        }
+        node = child->second;
+    }
+    // A whole name is never ambiguous, even if it is also the prefix of longer names.
+    const PrefixNode& prefix = commands.prefixes[node];
+    if (prefix.whole) {
+        opcode = prefix.exact;
+        return true;
+    }
+    if (1 == prefix.names) {
+        opcode = prefix.any;
+        return true;
+    }
+    return false;
+}
+
+bool Commands::find(std::string_view command, Opcode& opcode) {
+    const CommandRegistry& commands = registry();
+    auto location = commands.opcodes.find(command);
+    if (location == commands.opcodes.end()) {
+        return false;
+    }
+    opcode = location->second;
+    return true;
+}
+
+const std::string& Commands::name(Opcode opcode) {
+    const CommandRegistry& commands = registry();
+    if (opcode >= commands.names.size()) {
+        throw std::out_of_range("Unknown command opcode " + std::to_string(opcode));
+    }
+    return commands.names[opcode];
+}
+
+void CommandTable::insert(Opcode opcode, const Behavior::Ability* ability) {
+    if (abilities.size() <= opcode) {
+        abilities.resize(opcode + 1, nullptr);
+    }
+    if (nullptr == abilities[opcode] and nullptr != ability) {
+        abilities[opcode] = ability;
+        count += 1;
+    }
+}
+
+const Behavior::Ability* CommandTable::find(const std::string& command) const {
+    Opcode opcode = 0;
+    if (not Commands::find(command, opcode)) {
+        return nullptr;
+    }
+    return find(opcode);
+}
+
+bool CommandTable::empty() const {
+    return 0 == count;
+}
+
+std::vector<std::string> CommandTable::names() const {
+    std::vector<std::string> command_names;
+    for (Opcode opcode = 0; opcode < abilities.size(); ++opcode) {
+        if (nullptr != abilities[opcode]) {
+            command_names.push_back(Commands::name(opcode));
+        }
+    }
+    std::sort(command_names.begin(), command_names.end());
+    return command_names;
+}
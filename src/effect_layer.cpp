@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * A dense layer of visual effects, one per tile. Each mark is stamped with the current generation,
+ * so clearing the layer only advances the generation instead of touching every tile.
+ */
+
+#include <limits>
+
+#include "effect_layer.hpp"
+
+const char* effectColor(TileEffect effect) {
+    if (TileEffect::red == effect) {
+        return "red";
+    }
+    else if (TileEffect::cyan == effect) {
+        return "cyan";
+    }
+    return "black";
+}
+
+EffectLayer::EffectLayer(size_t field_height, size_t field_width) :
+    field_height(field_height), field_width(field_width), tiles(field_height, field_width) {
+}
+
+void EffectLayer::mark(size_t y, size_t x, TileEffect effect) {
+    if (y >= field_height or x >= field_width or TileEffect::none == effect) {
+        return;
+    }
+    Tile& tile = tiles.obtain(tiles.chunkOf(y, x))[tiles.offsetOf(y, x)];
+    if (tile.generation != generation) {
+        tile.generation = generation;
+        tile.effect = effect;
+        marked.push_back(y * field_width + x);
+    }
+}
+
+TileEffect EffectLayer::at(size_t y, size_t x) const {
+    if (y >= field_height or x >= field_width) {
+        return TileEffect::none;
+    }
+    const Chunk* chunk = tiles.find(tiles.chunkOf(y, x));
+    if (nullptr == chunk or (*chunk)[tiles.offsetOf(y, x)].generation != generation) {
+        return TileEffect::none;
+    }
+    return (*chunk)[tiles.offsetOf(y, x)].effect;
+}
+
+void EffectLayer::clear() {
+    marked.clear();
+    if (std::numeric_limits<uint32_t>::max() == generation) {
+        // Old stamps would become current again after wrapping around, so reset them.
+        for (size_t chunk : tiles.allocatedChunks()) {
+            tiles.find(chunk)->fill(Tile{});
+        }
+        generation = 0;
+    }
+    generation += 1;
+}
+
+void EffectLayer::releaseChunk(size_t chunk) {
+    tiles.release(chunk);
+}
+
+size_t EffectLayer::height() const {
+    return field_height;
+}
+
+size_t EffectLayer::width() const {
+    return field_width;
+}
@@ -42,25 +42,16 @@ json& getSlotInformation() {
 // Initialize the class-wide variable.
 std::atomic_size_t Entity::next_entity_id = 1;
 
-size_t tickIncrease(double rate, size_t tick_num) {
-    // Avoid storing any partial states by using the tick number to calculate if there are any whole
-    // gains at this time step.
-    // floor(rate * tick_num) - floor(rate * (tick_num-1))
-    // floor(rate + remainder((rate * (tick_num-1), 1))
-    // But those should only use the remainder if things were actually ticking up since last time.
-    // Don't really want to store all of the past states of ticking or not though, should be fine.
-    return floor(rate + fmod(rate * (tick_num-1), 1.0));
+double Stats::healthRegen() const {
+    return vitality*0.1 + domain*0.05;
 }
 
-void Stats::ticHealthManaStamina(size_t tick_num) {
-    double health_tick = vitality*0.1 + domain*0.05;
-    double mana_tick = channel_rate * 0.1;
-    double stamina_tick = 1.0 + cbrt(health_tick);
+double Stats::manaRegen() const {
+    return channel_rate * 0.1;
+}
 
-    // We obviously do not go beyond maximum values.
-    health = std::min(maxHealth(), health + tickIncrease(health_tick, tick_num));
-    mana = std::min(maxMana(), mana + tickIncrease(mana_tick, tick_num));
-    stamina = std::min(maxStamina(), stamina + tickIncrease(stamina_tick, tick_num));
+double Stats::staminaRegen() const {
+    return 1.0 + cbrt(healthRegen());
 }
 
 size_t Stats::maxMana() const {
@@ -82,31 +73,41 @@ size_t Stats::detectionRange() const {
 }
 
 std::string Entity::getSpecies() const {
-    auto species_location = std::find_if(traits.begin(), traits.end(),
+    std::vector<std::string> trait_names = traits.names();
+    auto species_location = std::find_if(trait_names.begin(), trait_names.end(),
             [](const std::string& entry){ return entry.starts_with("species:");});
-    if (species_location == traits.end()) {
+    if (species_location == trait_names.end()) {
         return "";
     }
     return species_location->substr(std::string("species:").size());
 }
 
 std::string Entity::getObjectType() const {
-    auto object_location = std::find_if(traits.begin(), traits.end(),
+    std::vector<std::string> trait_names = traits.names();
+    auto object_location = std::find_if(trait_names.begin(), trait_names.end(),
             [](const std::string& entry){ return entry.starts_with("object:");});
-    if (object_location == traits.end()) {
+    if (object_location == trait_names.end()) {
         return "";
     }
     return object_location->substr(std::string("object:").size());
 }
 
-// Constructor
-Entity::Entity(size_t y, size_t x, const std::string& name, const std::set<std::string> traits) {
+// Constructors
+Entity::Entity(size_t y, size_t x, const std::string& name, const std::set<std::string> traits) :
     // Assign the entity ID and increment the classwide variable to ensure the ID remains unique.
-    entity_id = Entity::next_entity_id.fetch_add(1);
+    Entity(Entity::next_entity_id.fetch_add(1), y, x, name, traits) {
+}
+
+Entity::Entity(size_t entity_id, size_t y, size_t x, const std::string& name, const std::set<std::string> traits) {
+    this->entity_id = entity_id;
+    // Entities restored in a new process must not have their IDs handed out again.
+    size_t next_id = Entity::next_entity_id.load();
+    while (next_id <= entity_id and not Entity::next_entity_id.compare_exchange_weak(next_id, entity_id + 1)) {
+    }
     this->y = y;
     this->x = x;
     this->name = name;
-    this->traits = traits;
+    this->traits = TraitSet(traits.begin(), traits.end());
 
     // If the traits defined a species then fill in stats. If there is no species then there are not
     // stats.
@@ -170,12 +171,31 @@ Entity::Entity(size_t y, size_t x, const std::string& name, const std::set<std::
     }
 }
 
-Entity::Entity(Entity&& other) : entity_id(other.entity_id), y(other.y), x(other.x), name(std::move(other.name)), traits(std::move(other.traits)), possible_slots(std::move(other.possible_slots)), occupied_slots(std::move(other.occupied_slots)), stats(other.stats), behavior_set_name(other.behavior_set_name), character(other.character), description(std::move(other.description)) {
+Entity::Entity(Entity&& other) noexcept : entity_id(other.entity_id), y(other.y), x(other.x), name(std::move(other.name)), traits(std::move(other.traits)), possible_slots(std::move(other.possible_slots)), occupied_slots(std::move(other.occupied_slots)), stats(other.stats), behavior_set_name(std::move(other.behavior_set_name)), character(std::move(other.character)), description(std::move(other.description)), command_handlers(std::move(other.command_handlers)), command_mastery(std::move(other.command_mastery)), core_commands(std::move(other.core_commands)) {
+    other.entity_id = 0;
+}
+
+Entity& Entity::operator=(Entity&& other) noexcept {
+    entity_id = other.entity_id;
+    y = other.y;
+    x = other.x;
+    name = std::move(other.name);
+    traits = std::move(other.traits);
+    possible_slots = std::move(other.possible_slots);
+    occupied_slots = std::move(other.occupied_slots);
+    stats = other.stats;
+    behavior_set_name = std::move(other.behavior_set_name);
+    character = std::move(other.character);
+    description = std::move(other.description);
+    command_handlers = std::move(other.command_handlers);
+    command_mastery = std::move(other.command_mastery);
+    core_commands = std::move(other.core_commands);
     other.entity_id = 0;
+    return *this;
 }
 
-std::string Entity::getDescription() const {
-    return OlymposLore::getDescription(*this);
+std::string Entity::getDescription(uint64_t world_seed) const {
+    return OlymposLore::getDescription(*this, world_seed);
 }
 
 bool Entity::operator==(const Entity& other) const {
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Conversion of entities to and from json, used to move entities out of memory while the part of
+ * the world that they are in is inactive.
+ */
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "behavior.hpp"
+#include "entity_serialization.hpp"
+
+json serializeStats(const Stats& stats) {
+    return json{
+        {"strength", stats.strength},
+        {"reflexes", stats.reflexes},
+        {"vitality", stats.vitality},
+        {"aura", stats.aura},
+        {"domain", stats.domain},
+        {"channel_rate", stats.channel_rate},
+        {"health", stats.health},
+        {"mana", stats.mana},
+        {"stamina", stats.stamina},
+        {"species_level", stats.species_level},
+        {"class1_level", stats.class1_level},
+        {"class2_level", stats.class2_level},
+        {"class3_level", stats.class3_level},
+    };
+}
+
+Stats deserializeStats(const json& record) {
+    Stats stats;
+    stats.strength = record.at("strength");
+    stats.reflexes = record.at("reflexes");
+    stats.vitality = record.at("vitality");
+    stats.aura = record.at("aura");
+    stats.domain = record.at("domain");
+    stats.channel_rate = record.at("channel_rate");
+    stats.health = record.at("health");
+    stats.mana = record.at("mana");
+    stats.stamina = record.at("stamina");
+    stats.species_level = record.at("species_level");
+    stats.class1_level = record.at("class1_level");
+    stats.class2_level = record.at("class2_level");
+    stats.class3_level = record.at("class3_level");
+    return stats;
+}
+
+json serializeEntity(const Entity& entity) {
+    json record{
+        {"id", entity.entity_id},
+        {"y", entity.y},
+        {"x", entity.x},
+        {"name", entity.name},
+        {"traits", entity.traits.names()},
+        {"behavior", entity.behavior_set_name},
+        {"mastery", entity.command_mastery},
+        {"core", entity.core_commands},
+        // Abilities are granted again from the ability sets rather than stored.
+        {"has_abilities", not entity.command_handlers.empty()},
+    };
+    if (entity.stats) {
+        record["stats"] = serializeStats(entity.stats.value());
+    }
+    json equipment = json::object();
+    for (auto& [slot, item] : entity.occupied_slots) {
+        equipment[slot] = serializeEntity(item);
+    }
+    record["equipment"] = std::move(equipment);
+    return record;
+}
+
+Entity deserializeEntity(const json& record) {
+    std::vector<std::string> trait_names = record.at("traits").get<std::vector<std::string>>();
+    Entity entity(record.at("id").get<size_t>(), record.at("y"), record.at("x"), record.at("name").get<std::string>(),
+        std::set<std::string>(trait_names.begin(), trait_names.end()));
+    // Traits may have changed since the entity was created from lore.
+    entity.traits = TraitSet(trait_names.begin(), trait_names.end());
+    entity.behavior_set_name = record.at("behavior").get<std::string>();
+    entity.command_mastery = record.at("mastery").get<std::map<std::string, double>>();
+    entity.core_commands = record.at("core").get<std::vector<std::string>>();
+    if (record.contains("stats")) {
+        entity.stats = deserializeStats(record.at("stats"));
+    }
+    else {
+        entity.stats.reset();
+    }
+    for (auto& [slot, item] : record.at("equipment").items()) {
+        entity.occupied_slots.emplace(slot, deserializeEntity(item));
+    }
+    if (record.at("has_abilities").get<bool>()) {
+        for (const Behavior::AbilitySet& abset : Behavior::getAbilities()) {
+            abset.updateAvailable(entity);
+        }
+    }
+    return entity;
+}
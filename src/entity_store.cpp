@@ -0,0 +1,167 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Contiguous storage for entities. Entities live in a dense array and are referred to with
+ * generational handles, so a handle to an entity that has been removed will simply fail to resolve
+ * instead of pointing at whatever entity now occupies its storage.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include "entity.hpp"
+#include "entity_store.hpp"
+
+EntityStore::iterator EntityStore::begin() {
+    return iterator(this, 0);
+}
+
+EntityStore::iterator EntityStore::end() {
+    return iterator(this, dense.size());
+}
+
+EntityStore::const_iterator EntityStore::begin() const {
+    return const_iterator(this, 0);
+}
+
+EntityStore::const_iterator EntityStore::end() const {
+    return const_iterator(this, dense.size());
+}
+
+EntityHandle EntityStore::insert(Entity&& entity) {
+    uint32_t slot_idx = 0;
+    if (free_slots.empty()) {
+        slot_idx = slots.size();
+        slots.push_back({0, 0});
+    }
+    else {
+        slot_idx = free_slots.back();
+        free_slots.pop_back();
+    }
+    Slot& slot = slots[slot_idx];
+    slot.dense_index = dense.size();
+
+    id_to_slot[entity.entity_id] = slot_idx;
+    dense.push_back(std::move(entity));
+    dense_slots.push_back(slot_idx);
+    return {slot_idx, slot.generation};
+}
+
+void EntityStore::erase(EntityHandle handle) {
+    if (not contains(handle)) {
+        return;
+    }
+    Slot& slot = slots[handle.slot];
+    uint32_t dense_idx = slot.dense_index;
+    id_to_slot.erase(dense[dense_idx].entity_id);
+
+    // Swap the last entity into the hole so that the array stays packed.
+    uint32_t last_idx = dense.size() - 1;
+    if (dense_idx != last_idx) {
+        dense[dense_idx] = std::move(dense[last_idx]);
+        dense_slots[dense_idx] = dense_slots[last_idx];
+        if (retired_slot != dense_slots[dense_idx]) {
+            slots[dense_slots[dense_idx]].dense_index = dense_idx;
+        }
+        else {
+            // Keep track of the retired entity's new location.
+            std::replace(retired.begin(), retired.end(), last_idx, dense_idx);
+        }
+    }
+    dense.pop_back();
+    dense_slots.pop_back();
+
+    // Bump the generation so that outstanding handles no longer resolve.
+    slot.generation += 1;
+    free_slots.push_back(handle.slot);
+}
+
+void EntityStore::retire(EntityHandle handle) {
+    if (not contains(handle)) {
+        return;
+    }
+    Slot& slot = slots[handle.slot];
+    id_to_slot.erase(dense[slot.dense_index].entity_id);
+    dense_slots[slot.dense_index] = retired_slot;
+    retired.push_back(slot.dense_index);
+
+    slot.generation += 1;
+    free_slots.push_back(handle.slot);
+}
+
+void EntityStore::compact() {
+    // Fill holes from the back so that each swap moves an entity that is not itself retired.
+    std::sort(retired.begin(), retired.end(), std::greater<uint32_t>());
+    for (uint32_t dense_idx : retired) {
+        uint32_t last_idx = dense.size() - 1;
+        if (dense_idx != last_idx) {
+            dense[dense_idx] = std::move(dense[last_idx]);
+            dense_slots[dense_idx] = dense_slots[last_idx];
+            slots[dense_slots[dense_idx]].dense_index = dense_idx;
+        }
+        dense.pop_back();
+        dense_slots.pop_back();
+    }
+    retired.clear();
+}
+
+bool EntityStore::contains(EntityHandle handle) const {
+    // Removing an entity bumps the generation of its slot, so a matching generation means that the
+    // handle is current.
+    return handle.slot < slots.size() and slots[handle.slot].generation == handle.generation;
+}
+
+Entity* EntityStore::get(EntityHandle handle) {
+    if (not contains(handle)) {
+        return nullptr;
+    }
+    return &dense[slots[handle.slot].dense_index];
+}
+
+const Entity* EntityStore::get(EntityHandle handle) const {
+    if (not contains(handle)) {
+        return nullptr;
+    }
+    return &dense[slots[handle.slot].dense_index];
+}
+
+Entity& EntityStore::at(EntityHandle handle) {
+    Entity* entity = get(handle);
+    if (nullptr == entity) {
+        throw std::out_of_range("Entity handle does not refer to a live entity.");
+    }
+    return *entity;
+}
+
+const Entity& EntityStore::at(EntityHandle handle) const {
+    const Entity* entity = get(handle);
+    if (nullptr == entity) {
+        throw std::out_of_range("Entity handle does not refer to a live entity.");
+    }
+    return *entity;
+}
+
+EntityHandle EntityStore::find(size_t entity_id) const {
+    auto found = id_to_slot.find(entity_id);
+    if (found == id_to_slot.end()) {
+        return {};
+    }
+    return {found->second, slots[found->second].generation};
+}
+
+EntityHandle EntityStore::handleOf(const Entity& entity) const {
+    return find(entity.entity_id);
+}
+
+size_t EntityStore::size() const {
+    return dense.size() - retired.size();
+}
+
+bool EntityStore::empty() const {
+    return 0 == size();
+}
+
+std::span<Entity> EntityStore::denseEntities() {
+    return dense;
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Distances from a set of goal tiles, found with one breadth first search that is shared by every
+ * entity heading towards or away from those goals. Entities move closer to a goal by stepping to
+ * a neighboring tile with a smaller distance, and farther by stepping to one with a larger
+ * distance. Distances are stamped with a generation, like EffectLayer, so recomputing a field does
+ * not need to clear it first.
+ */
+
+#include "flow_field.hpp"
+
+FlowField::FlowField(size_t field_height, size_t field_width) :
+    field_height(field_height), field_width(field_width), tiles(field_height, field_width) {
+}
+
+uint16_t FlowField::distance(size_t y, size_t x) const {
+    if (y >= field_height or x >= field_width) {
+        return unreachable;
+    }
+    const Chunk* chunk = tiles.find(tiles.chunkOf(y, x));
+    if (nullptr == chunk or (*chunk)[tiles.offsetOf(y, x)].generation != generation) {
+        return unreachable;
+    }
+    return (*chunk)[tiles.offsetOf(y, x)].distance;
+}
+
+void FlowField::releaseChunk(size_t chunk) {
+    tiles.release(chunk);
+}
+
+bool FlowField::set(size_t y, size_t x, uint16_t distance) {
+    if (y >= field_height or x >= field_width) {
+        return false;
+    }
+    Tile& tile = tiles.obtain(tiles.chunkOf(y, x))[tiles.offsetOf(y, x)];
+    if (tile.generation == generation) {
+        return false;
+    }
+    tile.generation = generation;
+    tile.distance = distance;
+    return true;
+}
+
+void FlowField::advanceGeneration() {
+    if (std::numeric_limits<uint32_t>::max() == generation) {
+        // Old stamps would become current again after wrapping around, so reset them.
+        for (size_t chunk : tiles.allocatedChunks()) {
+            tiles.find(chunk)->fill(Tile{});
+        }
+        generation = 0;
+    }
+    generation += 1;
+}
@@ -10,13 +10,14 @@
 #include <cmath>
 #include <filesystem>
 #include <fstream>
-#include <random>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include "lore.hpp"
 #include "entity.hpp"
+#include "random_stream.hpp"
+#include "trait_set.hpp"
 
 using json = nlohmann::json;
 
@@ -25,7 +26,20 @@ json species;
 // Objects in the world.
 json objects;
 
-std::mt19937 randgen{std::random_device{}()};
+// Intern every trait that lore entries can grant so that they receive the low trait IDs.
+void internLoreTraits(const json& lore, const std::string& prefix) {
+    for (auto& [lore_name, entry] : lore.items()) {
+        Traits::intern(prefix + lore_name);
+        Traits::intern(lore_name);
+        for (const std::string field : {"is a", "has a"}) {
+            if (entry.contains(field)) {
+                for (const std::string& trait : entry.at(field).get<std::vector<std::string>>()) {
+                    Traits::intern(trait);
+                }
+            }
+        }
+    }
+}
 
 json& OlymposLore::getSpeciesLore() {
     // Read in the file if it hasn't already been done.
@@ -37,6 +51,7 @@ json& OlymposLore::getSpeciesLore() {
                 std::string contents;
                 std::getline(istream, contents, '\0');
                 species = json::parse(contents);
+                internLoreTraits(species, "species:");
             }
         }
     }
@@ -53,6 +68,7 @@ json& OlymposLore::getObjectLore() {
                 std::string contents;
                 std::getline(istream, contents, '\0');
                 objects = json::parse(contents);
+                internLoreTraits(objects, "object:");
             }
         }
     }
@@ -77,7 +93,7 @@ std::tuple<json&, json&> getIsAHasA(const Entity& entity) {
     }
 }
 
-std::string OlymposLore::getDescription(const Entity& entity) {
+std::string OlymposLore::getDescription(const Entity& entity, uint64_t world_seed) {
     json& species = getSpeciesLore();
     json& objects = getObjectLore();
     std::string species_name = entity.getSpecies();
@@ -94,15 +110,15 @@ std::string OlymposLore::getDescription(const Entity& entity) {
         description = object_type + ": ";
     }
     auto [json_is_a, json_has_a] = getIsAHasA(entity);
+    // Each entity is always described the same way within a world.
+    RandomStream randgen(world_seed, entity.entity_id, 0, RandomStream::Purpose::description);
     std::string is_a = "A mysterious entity";
     if (0 < json_is_a.size()) {
-        std::uniform_int_distribution<int> uniform_dist(0, json_is_a.size()-1);
-        is_a = json_is_a[uniform_dist(randgen)].get<std::string>();
+        is_a = json_is_a[randgen.uniform(0, json_is_a.size()-1)].get<std::string>();
     }
     std::string has_a = "";
     if (0 < json_has_a.size()) {
-        std::uniform_int_distribution<int> uniform_dist(0, json_has_a.size()-1);
-        has_a = " that has a " + json_has_a[uniform_dist(randgen)].get<std::string>();
+        has_a = " that has a " + json_has_a[randgen.uniform(0, json_has_a.size()-1)].get<std::string>();
         // We could do something like this, but it is a bit insane.
         // std::sample(json_is_a.begin(), json_is_a.end(), std::back_inserter(is_a), 1, randgen);
     }
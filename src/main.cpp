@@ -13,14 +13,16 @@
 #include <algorithm>
 #include <chrono>
 #include <deque>
+#include <future>
 #include <iostream>
-#include <list>
+#include <random>
 #include <regex>
 #include <utility>
 #include <vector>
 
 #include "command_handler.hpp"
 #include "entity.hpp"
+#include "simulation.hpp"
 #include "user_interface.hpp"
 #include "world_state.hpp"
 #include "behavior.hpp"
@@ -57,7 +59,7 @@ void setupCursesEnv() {
 }
 
 
-std::map<std::string, UIComponent> createPlayerHelp(const std::list<Entity>::iterator player_i) {
+std::map<std::string, UIComponent> createPlayerHelp(const Entity& player) {
     std::map<std::string, UIComponent> help_components;
     {
         auto insert_stat = help_components.emplace(std::make_pair("abilities", UIComponent(38, 76, 1, 2)));
@@ -66,11 +68,12 @@ std::map<std::string, UIComponent> createPlayerHelp(const std::list<Entity>::ite
         UserInterface::drawString(uic.window, "Type `help' and an ability name for more information.", 2, 0);
         UserInterface::drawString(uic.window, "Available abilities are:", 3, 0);
         size_t cur_row = 3;
-        for (auto& [cmd_name, ability] : player_i->command_details) {
+        for (const std::string& cmd_name : player.command_handlers.names()) {
             UserInterface::drawString(uic.window, cmd_name, ++cur_row, 5);
         }
     }
-    for (auto& [cmd_name, ability] : player_i->command_details) {
+    for (const std::string& cmd_name : player.command_handlers.names()) {
+        const Behavior::Ability& ability = *player.command_handlers.find(cmd_name);
         // Insert a tuple for this key.
         auto insert_stat = help_components.emplace(std::make_pair(cmd_name, UIComponent(38, 76, 1, 2)));
         UIComponent& uic = insert_stat.first->second;
@@ -221,17 +224,20 @@ int main(int argc, char** argv) {
 
     // Our generic command handler
     CommandHandler comham;
+    // Commands typed by the player. They are queued without waiting for a tick in progress.
+    CommandHandler::Producer& player_input = comham.addProducer();
 
-    // Initialize the world state with the desired size.
+    // Initialize the world state with the desired size. Every game plays out differently.
     WorldState ws(40, 80);
+    ws.seed = std::random_device{}();
 
     // Get the abilities so that they can be assigned to the mobs.
     const std::vector<Behavior::AbilitySet>& abilities = Behavior::getAbilities();
 
     // Make some mobs
-    ws.addEntity(10, 1, "Bob", {"player", "species:human", "mob"});
+    EntityHandle bob = ws.addEntity(10, 1, "Bob", {"player", "species:human", "mob"});
     // The player shouldn't have an automatic behavior set.
-    ws.entities.back().behavior_set_name = "none";
+    ws.entities.at(bob).behavior_set_name = "none";
     ws.addEntity(10, 10, "Blue Slime", {"species:slime", "mob", "auto"});
     ws.addEntity(10, 12, "Green Slime", {"species:slime", "mob", "auto"});
     ws.addEntity(8, 10, "Purple Slime", {"species:slime", "mob", "auto"});
@@ -254,7 +260,7 @@ int main(int argc, char** argv) {
     // Keep an easy handle to access the player
     // TODO If we keep this here is there any reason for the world state to bother tracking some
     // named entities?
-    auto player_i = ws.findEntity(std::vector<std::string>{"player"});
+    EntityHandle player_i = ws.findEntity(std::vector<std::string>{"player"});
 
     // Create a new window to display status.
     WINDOW* stat_window = newwin(40, 30, 0, ws.field_width + 10);
@@ -274,7 +280,7 @@ int main(int argc, char** argv) {
     }
 
     // Create (and hide) a dialog window for help screens.
-    std::map<std::string, UIComponent> help_components = createPlayerHelp(player_i);
+    std::map<std::string, UIComponent> help_components = createPlayerHelp(ws.entities.at(player_i));
 
     // Create a panel that will be used for generic dialog.
     UIComponent dialog_box(38, 76, 1, 2);
@@ -287,9 +293,10 @@ int main(int argc, char** argv) {
 
     // Wait 50 ms for user input and then handle any of the background game stuff that should be
     // happening. Unless the user has disabled ticking.
-    if (0.0 < tick_rate) {
-        wtimeout(window, 50);
-    }
+    const int input_timeout = 0.0 < tick_rate ? 50 : -1;
+    // While a tick runs, check back often so that the world is drawn soon after it finishes.
+    const int ticking_input_timeout = 5;
+    wtimeout(window, input_timeout);
 
     ws.initialize();
 
@@ -297,7 +304,7 @@ int main(int argc, char** argv) {
     std::set<std::string> nav_shortcuts{"north", "east", "south", "west"};
     // Doesn't seem to be easy for someone to use a function 0 key.
     function_shortcuts.push_back("");
-    for (auto& [key, value] : player_i->command_handlers) {
+    for (const std::string& key : ws.entities.at(player_i).command_handlers.names()) {
         if (12 > function_shortcuts.size() and not nav_shortcuts.contains(key)) {
             function_shortcuts.push_back(key);
         }
@@ -308,7 +315,7 @@ int main(int argc, char** argv) {
 
     // Draw the player's status in the window
     {
-        size_t status_row = UserInterface::drawStatus(stat_window, *player_i, 3, 1);
+        size_t status_row = UserInterface::drawStatus(stat_window, ws.entities.at(player_i), ws.seed, 3, 1);
         UserInterface::drawHotkeys(stat_window, status_row+2, function_shortcuts);
     }
 
@@ -316,7 +323,7 @@ int main(int argc, char** argv) {
     ws.update();
 
     // Update panels, refresh the screen, and reset the cursor position
-    UserInterface::updateDisplay(window, ws.entities);
+    UserInterface::updateDisplay(window, ws.entities, ws.tile_effects);
     UserInterface::clearInput(window, ws.field_height, ws.field_width);
     doupdate();
 
@@ -329,6 +336,10 @@ int main(int argc, char** argv) {
     bool in_dialog = false;
     decltype(help_components)::iterator help_displayed = help_components.end();
     std::string command = "";
+    // Ticks run on a separate thread so that typing is echoed even while a slow tick is running.
+    // The world state belongs to that thread until the tick finishes, and commands that are typed
+    // in the meantime are taken by the next tick.
+    std::future<void> tick_result;
 
     // The introduction should be displayed immediately.
     in_dialog = true;
@@ -339,6 +350,7 @@ int main(int argc, char** argv) {
     doupdate();
 
     while(not quit) {
+        wtimeout(window, tick_result.valid() ? ticking_input_timeout : input_timeout);
         int in_c = processUserInput(window, command, function_shortcuts);
         // Process a command on a new line.
         if ('\n' == in_c) {
@@ -385,12 +397,12 @@ int main(int argc, char** argv) {
                 std::regex semicolon_or_end("(;|$)");
                 std::smatch matches;
                 while (0 < command.size() and std::regex_search(command, matches, semicolon_or_end)) {
-                    comham.enqueueTraitCommand({"player"}, matches.prefix().str());
+                    player_input.enqueueTraitCommand({"player"}, matches.prefix().str());
                     // Try to process the rest of the command
                     command = matches.suffix().str();
                 }
                 if (0 < command.size()) {
-                    comham.enqueueTraitCommand({"player"}, command);
+                    player_input.enqueueTraitCommand({"player"}, command);
                 }
                 // There is a command to process.
                 has_command = true;
@@ -429,76 +441,77 @@ int main(int argc, char** argv) {
 
         auto cur_time = std::chrono::steady_clock::now();
         std::chrono::duration<double> time_diff = cur_time - last_update;
-        if (not in_dialog and help_displayed == help_components.end() and ws.entities.end() != player_i ) {
+        // Show the results of a tick once it has finished.
+        if (tick_result.valid() and
+            std::future_status::ready == tick_result.wait_for(std::chrono::seconds(0))) {
+            tick_result.get();
+            Entity* player_entity = ws.entities.get(ws.findEntity(std::vector<std::string>{"player"}));
+            if (nullptr != player_entity) {
+            // Find the user visible events.
+            std::vector<std::string> player_events = ws.getLocalEvents(*player_entity, player_entity->stats.value().detectionRange());
+                for (std::string& event : player_events) {
+                    event_strings.push_front(event);
+                }
+                // Limit to 40 events in the event window.
+                while (40 < event_strings.size()) {
+                    event_strings.pop_back();
+                }
+                // Clear the events after the user-visible ones have been dealt with.
+                ws.clearEvents();
+                // Draw the user visible events
+                UserInterface::updateEvents(event_window, event_strings);
+                // Update the player's status in the window
+                size_t status_row = UserInterface::drawStatus(stat_window, *player_entity, ws.seed, 3, 1);
+                status_row = UserInterface::drawInfolog(stat_window, status_row + 2, ws.info_log);
+                UserInterface::drawHotkeys(stat_window, status_row+2, function_shortcuts);
+                update_panels();
+            }
+            else {
+                // TODO Should play the last events that the player could have seen, since they
+                // will probably include the player's death.
+            }
+        }
+        // Nothing else may touch the world state while a tick is running.
+        bool ticking = tick_result.valid();
+        if (not ticking and not in_dialog and help_displayed == help_components.end() and ws.entities.contains(player_i)) {
             if ((0.0 != tick_rate and tick_rate <= time_diff.count()) or
                 (0.0 >= tick_rate and has_command)) {
-                // Handle automated behaviors.
-                const std::map<std::string, Behavior::BehaviorSet>& behaviors = Behavior::getBehaviors();
-                for (Entity& entity : ws.entities) {
-                    if (behaviors.contains(entity.behavior_set_name)) {
-                        behaviors.at(entity.behavior_set_name).executeBehavior(entity, ws, comham);
-                    }
-                }
                 has_command = false;
                 // Update the last updated time and the time diff since it is used in some later
                 // logic.
                 last_update = cur_time;
                 time_diff = cur_time - last_update;
-                // execute all commands every tick
-                comham.executeCommands(ws);
-                // Tick update
-                ws.update();
-                auto player_entity = ws.findEntity(std::vector<std::string>{"player"});
-                if (player_entity != ws.entities.end()) {
-                // Find the user visible events.
-                std::vector<std::string> player_events = ws.getLocalEvents(player_entity->y, player_entity->x, player_entity->stats.value().detectionRange());
-                    for (std::string& event : player_events) {
-                        event_strings.push_front(event);
-                    }
-                    // Limit to 40 events in the event window.
-                    while (40 < event_strings.size()) {
-                        event_strings.pop_back();
-                    }
-                    // Clear the events after the user-visible ones have been dealt with.
-                    ws.clearEvents();
-                    // Draw the user visible events
-                    UserInterface::updateEvents(event_window, event_strings);
-                    // Update the player's status in the window
-                    size_t status_row = UserInterface::drawStatus(stat_window, *player_entity, 3, 1);
-                    status_row = UserInterface::drawInfolog(stat_window, status_row + 2, ws.info_log);
-                    UserInterface::drawHotkeys(stat_window, status_row+2, function_shortcuts);
-                    update_panels();
-                }
-                else {
-                    // TODO Should play the last events that the player could have seen, since they
-                    // will probably include the player's death.
-                }
+                // Run automated behaviors, execute all commands, and update the world.
+                tick_result = std::async(std::launch::async, [&]() {Simulation::tick(ws, comham);});
+                ticking = true;
             }
         }
 
-        // Update the player in case they have died or the trait has transferred to a new entity.
-        player_i = ws.findEntity(std::vector<std::string>{"player"});
-        // See if the player has died.
-        if (ws.entities.end() == player_i and not in_dialog) {
-            dialog_box.renderDialogue(UserInterface::getDialogue("game over"));
-            dialog_box.show();
-            in_dialog = true;
-            update_panels();
+        if (not ticking) {
+            // Update the player in case they have died or the trait has transferred to a new entity.
+            player_i = ws.findEntity(std::vector<std::string>{"player"});
+            // See if the player has died.
+            if (not ws.entities.contains(player_i) and not in_dialog) {
+                dialog_box.renderDialogue(UserInterface::getDialogue("game over"));
+                dialog_box.show();
+                in_dialog = true;
+                update_panels();
+            }
         }
 
         // Update panels, refresh the screen, and reset the cursor position
 
         // In some systems writing to the game panel overwrites the dialog, even though its panel
         // should be on top of the game window.
-        if (not in_dialog) {
+        if (not in_dialog and not ticking) {
             // Draw background effects in the first half of the tic.
             if (time_diff.count() < tick_rate / 2) {
-                UserInterface::updateDisplay(window, ws.entities, ws.background_effects);
+                UserInterface::updateDisplay(window, ws.entities, ws.tile_effects);
             }
             else {
                 // Clear things that don't persist
-                ws.background_effects.clear();
-                UserInterface::updateDisplay(window, ws.entities);
+                ws.tile_effects.clear();
+                UserInterface::updateDisplay(window, ws.entities, ws.tile_effects);
             }
         }
         // Need to redraw the command since we've just erased the window.
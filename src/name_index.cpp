@@ -0,0 +1,120 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * An index from case folded entity names to entities. Name searches are case insensitive
+ * substring (or regex) searches, so rather than checking every entity this checks each distinct
+ * name once and remembers which names matched each pattern.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+
+#include "name_index.hpp"
+
+std::string foldCase(const std::string& str) {
+    std::string folded = str;
+    std::transform(folded.begin(), folded.end(), folded.begin(),
+        [](unsigned char c) {return std::tolower(c);});
+    return folded;
+}
+
+void NameIndex::insert(EntityHandle entity, const std::string& name) {
+    auto [location, inserted] = names.try_emplace(foldCase(name));
+    if (positions.size() <= entity.slot) {
+        positions.resize(entity.slot + 1);
+    }
+    positions[entity.slot] = location->second.size();
+    location->second.push_back(entity);
+    if (inserted) {
+        names_version += 1;
+    }
+}
+
+void NameIndex::erase(EntityHandle entity, const std::string& name) {
+    auto location = names.find(foldCase(name));
+    if (location == names.end()) {
+        return;
+    }
+    std::vector<EntityHandle>& handles = location->second;
+    if (entity.slot >= positions.size() or positions[entity.slot] >= handles.size() or
+        handles[positions[entity.slot]] != entity) {
+        return;
+    }
+    // Swap the last entity into the hole.
+    EntityHandle moved = handles.back();
+    handles[positions[entity.slot]] = moved;
+    positions[moved.slot] = positions[entity.slot];
+    handles.pop_back();
+    if (handles.empty()) {
+        names.erase(location);
+        names_version += 1;
+    }
+}
+
+bool isLiteral(const std::string& pattern) {
+    return std::string::npos == pattern.find_first_of(R"(\^$.|?*+()[]{})");
+}
+
+bool NameIndex::mayMatch(const std::string& pattern, const std::string& name) {
+    return not isLiteral(pattern) or std::string::npos != foldCase(name).find(foldCase(pattern));
+}
+
+NameIndex::CompiledPattern& NameIndex::compile(const std::string& pattern) {
+    auto cached = pattern_cache.find(pattern);
+    if (cached != pattern_cache.end()) {
+        return cached->second;
+    }
+    if (pattern_cache.size() >= max_cached_patterns) {
+        pattern_cache.clear();
+    }
+
+    CompiledPattern compiled;
+    compiled.literal = isLiteral(pattern);
+    if (compiled.literal) {
+        compiled.folded = foldCase(pattern);
+    }
+    else {
+        compiled.regex = std::regex(pattern, std::regex_constants::icase);
+    }
+    return pattern_cache.emplace(pattern, std::move(compiled)).first->second;
+}
+
+std::vector<EntityHandle> NameIndex::find(const std::string& pattern) {
+    // Patterns are usually cached and up to date, in which case readers do not block each other.
+    {
+        std::shared_lock lock(cache_mutex);
+        auto cached = pattern_cache.find(pattern);
+        if (cached != pattern_cache.end() and cached->second.version == names_version) {
+            return collect(cached->second);
+        }
+    }
+
+    std::unique_lock lock(cache_mutex);
+    CompiledPattern& compiled = compile(pattern);
+    // Only rescan the distinct names if they have changed since this pattern was last used.
+    if (compiled.version != names_version) {
+        compiled.matching_names.clear();
+        for (auto& [name, handles] : names) {
+            bool match = compiled.literal ?
+                std::string::npos != name.find(compiled.folded) :
+                std::regex_search(name, compiled.regex);
+            if (match) {
+                compiled.matching_names.push_back(name);
+            }
+        }
+        compiled.version = names_version;
+    }
+    return collect(compiled);
+}
+
+std::vector<EntityHandle> NameIndex::collect(const CompiledPattern& compiled) const {
+    std::vector<EntityHandle> found;
+    for (const std::string& name : compiled.matching_names) {
+        const std::vector<EntityHandle>& handles = names.at(name);
+        found.insert(found.end(), handles.begin(), handles.end());
+    }
+    std::sort(found.begin(), found.end(),
+        [](const EntityHandle& a, const EntityHandle& b) {return a.slot < b.slot;});
+    return found;
+}
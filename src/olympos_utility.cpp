@@ -4,6 +4,7 @@
  * Some utility functions.
  */
 
+#include <cstdlib>
 #include <cwchar>
 #include <clocale>
 
@@ -22,4 +23,8 @@ namespace OlymposUtility {
         [[maybe_unused]] std::size_t written = mbsrtowcs(&converted[0], &in_data, converted.size(), &state);
         return converted;
     }
+
+    size_t manhattanDistance(int64_t y1, int64_t x1, int64_t y2, int64_t x2) {
+        return std::llabs(y1 - y2) + std::llabs(x1 - x2);
+    }
 }
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Point to point routes over passable terrain, found with A*. Routes are cached per entity and are
+ * only planned again when the entity leaves its route, the goal changes, or a tile along the
+ * route becomes impassable. The tiles of a route are only checked again after the terrain changes.
+ */
+
+#include <algorithm>
+#include <queue>
+#include <tuple>
+
+#include "olympos_utility.hpp"
+#include "pathfinder.hpp"
+#include "world_state.hpp"
+
+std::vector<Pathfinder::Tile> Pathfinder::findPath(const WorldState& ws, Tile start, Tile goal) {
+    auto [goal_y, goal_x] = goal;
+    auto key = [&](size_t y, size_t x) {return y * ws.field_width + x;};
+    auto heuristic = [&](size_t y, size_t x) {
+        return OlymposUtility::manhattanDistance(y, x, goal_y, goal_x);
+    };
+
+    // Steps from the start and the tile each tile was reached from, by row major index.
+    std::unordered_map<size_t, std::pair<size_t, size_t>> visited;
+    // Open tiles as {estimated total, steps from start, row major index}. Ties go to the tile with
+    // more steps taken, which is closer to the goal.
+    using Open = std::tuple<size_t, size_t, size_t>;
+    auto later = [](const Open& a, const Open& b) {
+        return std::get<0>(a) > std::get<0>(b) or
+            (std::get<0>(a) == std::get<0>(b) and std::get<1>(a) < std::get<1>(b));
+    };
+    std::priority_queue<Open, std::vector<Open>, decltype(later)> open(later);
+
+    const size_t start_key = key(start.first, start.second);
+    const size_t goal_key = key(goal_y, goal_x);
+    visited[start_key] = {0, start_key};
+    open.push({heuristic(start.first, start.second), 0, start_key});
+    size_t expanded = 0;
+    while (not open.empty() and expanded < max_expanded) {
+        auto [estimate, steps, tile] = open.top();
+        open.pop();
+        if (steps != visited.at(tile).first) {
+            // A shorter way to this tile was already expanded.
+            continue;
+        }
+        if (goal_key == tile) {
+            std::vector<Tile> path;
+            for (size_t at = tile; at != start_key; at = visited.at(at).second) {
+                path.push_back({at / ws.field_width, at % ws.field_width});
+            }
+            std::reverse(path.begin(), path.end());
+            return path;
+        }
+        ++expanded;
+        size_t y = tile / ws.field_width;
+        size_t x = tile % ws.field_width;
+        // Wrap around at the edges is caught by the bounds checks.
+        for (auto [ny, nx] : {Tile{y - 1, x}, Tile{y + 1, x}, Tile{y, x - 1}, Tile{y, x + 1}}) {
+            if (ny >= ws.field_height or nx >= ws.field_width) {
+                continue;
+            }
+            size_t neighbor = key(ny, nx);
+            if (neighbor != goal_key and not ws.isPassableTerrain(ny, nx)) {
+                continue;
+            }
+            auto seen = visited.find(neighbor);
+            if (seen == visited.end() or steps + 1 < seen->second.first) {
+                visited[neighbor] = {steps + 1, tile};
+                open.push({steps + 1 + heuristic(ny, nx), steps + 1, neighbor});
+            }
+        }
+    }
+    return {};
+}
+
+bool Pathfinder::stillValid(const WorldState& ws, Route& route, Tile start, Tile goal) {
+    if (route.goal != goal) {
+        return false;
+    }
+    while (not route.tiles.empty() and route.tiles.back() == start) {
+        route.tiles.pop_back();
+    }
+    if (route.tiles.empty() or 1 != OlymposUtility::manhattanDistance(start.first, start.second,
+        route.tiles.back().first, route.tiles.back().second)) {
+        return false;
+    }
+    if (route.terrain_version == ws.terrainVersion()) {
+        return true;
+    }
+    // The goal may be occupied, but every tile before it must still be passable.
+    bool passable = std::all_of(route.tiles.begin() + 1, route.tiles.end(),
+        [&](const Tile& tile) {return ws.isPassableTerrain(tile.first, tile.second);});
+    if (passable) {
+        route.terrain_version = ws.terrainVersion();
+    }
+    return passable;
+}
+
+std::optional<Pathfinder::Tile> Pathfinder::nextStep(const WorldState& ws, size_t entity_id, Tile start, Tile goal) {
+    if (start == goal) {
+        return std::nullopt;
+    }
+    Route& route = routes[entity_id];
+    if (not stillValid(ws, route, start, goal)) {
+        route.goal = goal;
+        route.tiles = findPath(ws, start, goal);
+        std::reverse(route.tiles.begin(), route.tiles.end());
+        route.terrain_version = ws.terrainVersion();
+    }
+    if (route.tiles.empty()) {
+        return std::nullopt;
+    }
+    return route.tiles.back();
+}
+
+void Pathfinder::forget(size_t entity_id) {
+    routes.erase(entity_id);
+}
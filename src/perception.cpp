@@ -0,0 +1,67 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Memoized target searches. Many entities search for the same few targets every tick (the player,
+ * usually), so the entities that match each target are gathered once and nearest entity searches
+ * only need to check those candidates. Candidates are found from their current locations, so
+ * movement does not invalidate them, but adding or removing a matching entity does.
+ */
+
+#include <algorithm>
+#include <mutex>
+
+#include "entity.hpp"
+#include "name_index.hpp"
+#include "perception.hpp"
+
+namespace {
+    bool sameQuery(const TraitQuery& a, const TraitQuery& b) {
+        return a.satisfiable == b.satisfiable and a.required == b.required;
+    }
+}
+
+const Perception::Candidates* Perception::recall(const TraitQuery& query) const {
+    std::shared_lock lock(mutex);
+    for (const auto& [target, candidates] : trait_targets) {
+        if (sameQuery(target, query)) {
+            return &candidates;
+        }
+    }
+    return nullptr;
+}
+
+const Perception::Candidates* Perception::recall(const std::string& name) const {
+    std::shared_lock lock(mutex);
+    auto found = name_targets.find(name);
+    if (found == name_targets.end()) {
+        return nullptr;
+    }
+    return &found->second;
+}
+
+const Perception::Candidates& Perception::remember(const TraitQuery& query, Candidates&& candidates) {
+    std::unique_lock lock(mutex);
+    for (const auto& [target, remembered] : trait_targets) {
+        if (sameQuery(target, query)) {
+            return remembered;
+        }
+    }
+    return trait_targets.emplace_back(query, std::move(candidates)).second;
+}
+
+const Perception::Candidates& Perception::remember(const std::string& name, Candidates&& candidates) {
+    std::unique_lock lock(mutex);
+    return name_targets.try_emplace(name, std::move(candidates)).first->second;
+}
+
+void Perception::entityChanged(const Entity& entity) {
+    std::unique_lock lock(mutex);
+    std::erase_if(trait_targets, [&](const auto& item) {return item.first.matches(entity.traits);});
+    std::erase_if(name_targets, [&](const auto& item) {return NameIndex::mayMatch(item.first, entity.name);});
+}
+
+void Perception::clear() {
+    std::unique_lock lock(mutex);
+    trait_targets.clear();
+    name_targets.clear();
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Counter based random numbers. Each stream is identified by the world seed, an entity, the tick,
+ * and the purpose of the numbers, and its values are a hash of that key and a counter.
+ */
+
+#include "random_stream.hpp"
+
+namespace {
+    // The splitmix64 finalizer, which spreads every input bit across the output.
+    uint64_t mix(uint64_t value) {
+        value += 0x9E3779B97F4A7C15ull;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+}
+
+RandomStream::RandomStream(uint64_t seed, uint64_t entity_id, uint64_t tick, Purpose purpose) {
+    // Chain the parts of the key so that swapping two of them gives a different stream.
+    key = mix(mix(mix(mix(seed) ^ entity_id) ^ tick) ^ static_cast<uint64_t>(purpose));
+}
+
+RandomStream::result_type RandomStream::operator()() {
+    return mix(key ^ mix(counter++));
+}
+
+int64_t RandomStream::uniform(int64_t low, int64_t high) {
+    if (high <= low) {
+        return low;
+    }
+    const uint64_t span = static_cast<uint64_t>(high - low) + 1;
+    if (0 == span) {
+        // The range covers every value.
+        return static_cast<int64_t>((*this)());
+    }
+    // Reject the values at the top that would make some results more likely than others.
+    const uint64_t limit = max() - max() % span;
+    uint64_t value = (*this)();
+    while (value >= limit) {
+        value = (*this)();
+    }
+    return low + static_cast<int64_t>(value % span);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Per-tick regeneration of health, mana, and stamina. The derived maxima and regeneration rates of
+ * every entity with stats are cached in packed parallel arrays, so a tick is a straight pass over
+ * those arrays instead of recomputing them for every entity.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "entity.hpp"
+#include "regen_table.hpp"
+
+void RegenTable::set(EntityHandle handle, const Stats& stats) {
+    if (handle.slot >= slot_rows.size()) {
+        slot_rows.resize(handle.slot + 1, no_row);
+    }
+    uint32_t row = slot_rows[handle.slot];
+    if (no_row == row) {
+        row = handles.size();
+        slot_rows[handle.slot] = row;
+        handles.push_back(handle);
+        for (auto* column : {&health_rate, &mana_rate, &stamina_rate}) {
+            column->push_back(0.0);
+        }
+        for (auto* column : {&max_health, &max_mana, &max_stamina, &health_gain, &mana_gain, &stamina_gain}) {
+            column->push_back(0);
+        }
+    }
+    handles[row] = handle;
+    health_rate[row] = stats.healthRegen();
+    mana_rate[row] = stats.manaRegen();
+    stamina_rate[row] = stats.staminaRegen();
+    max_health[row] = stats.maxHealth();
+    max_mana[row] = stats.maxMana();
+    max_stamina[row] = stats.maxStamina();
+}
+
+void RegenTable::erase(EntityHandle handle) {
+    if (handle.slot >= slot_rows.size() or no_row == slot_rows[handle.slot]) {
+        return;
+    }
+    uint32_t row = slot_rows[handle.slot];
+    slot_rows[handle.slot] = no_row;
+
+    // Move the last row into the hole so that the arrays stay packed.
+    uint32_t last_row = handles.size() - 1;
+    if (row != last_row) {
+        handles[row] = handles[last_row];
+        slot_rows[handles[row].slot] = row;
+    }
+    handles.pop_back();
+    for (auto* column : {&health_rate, &mana_rate, &stamina_rate}) {
+        (*column)[row] = column->back();
+        column->pop_back();
+    }
+    for (auto* column : {&max_health, &max_mana, &max_stamina, &health_gain, &mana_gain, &stamina_gain}) {
+        (*column)[row] = column->back();
+        column->pop_back();
+    }
+}
+
+size_t RegenTable::size() const {
+    return handles.size();
+}
+
+EntityHandle RegenTable::handle(size_t row) const {
+    return handles[row];
+}
+
+// Whole points gained on this tick at the given rate, without storing any partial progress:
+// floor(rate + fractional part of rate * (tick_num - 1)). For non-negative values the fractional
+// part is exactly x - floor(x), which unlike fmod can be vectorized.
+void tickGains(const std::vector<double>& rates, std::vector<size_t>& gains, double previous_tick) {
+    const double* rate = rates.data();
+    size_t* gain = gains.data();
+    const size_t size = rates.size();
+    for (size_t row = 0; row < size; ++row) {
+        const double progress = rate[row] * previous_tick;
+        gain[row] = std::floor(rate[row] + (progress - std::floor(progress)));
+    }
+}
+
+void RegenTable::computeGains(size_t tick_num) {
+    const double previous_tick = tick_num - 1;
+    tickGains(health_rate, health_gain, previous_tick);
+    tickGains(mana_rate, mana_gain, previous_tick);
+    tickGains(stamina_rate, stamina_gain, previous_tick);
+}
+
+void RegenTable::apply(size_t row, Stats& stats) const {
+    // We obviously do not go beyond maximum values.
+    stats.health = std::min(max_health[row], stats.health + health_gain[row]);
+    stats.mana = std::min(max_mana[row], stats.mana + mana_gain[row]);
+    stats.stamina = std::min(max_stamina[row], stats.stamina + stamina_gain[row]);
+}
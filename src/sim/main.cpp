@@ -0,0 +1,151 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Headless simulation. Runs the game's tick pipeline without a terminal for a fixed number of
+ * ticks and reports the tick rate and the time spent in each phase.
+ *
+ * Usage: olympos-sim [scenario.json] [ticks]
+ */
+
+// C headers
+#include <clocale>
+
+#include <nlohmann/json.hpp>
+
+// C++ headers
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "behavior.hpp"
+#include "command_handler.hpp"
+#include "entity.hpp"
+#include "simulation.hpp"
+#include "world_state.hpp"
+
+using json = nlohmann::json;
+
+json loadScenario(const std::string& path) {
+    if (not std::filesystem::exists(path)) {
+        throw std::runtime_error("Scenario file " + path + " does not exist.");
+    }
+    std::ifstream istream(path, std::ios::binary);
+    return json::parse(istream);
+}
+
+// Place every population of the scenario onto random passable tiles.
+std::vector<EntityHandle> populate(WorldState& ws, const json& scenario, std::mt19937& randgen) {
+    std::vector<EntityHandle> placed;
+    std::uniform_int_distribution<size_t> rand_y(0, ws.field_height - 1);
+    std::uniform_int_distribution<size_t> rand_x(0, ws.field_width - 1);
+    for (const json& population : scenario.at("populations")) {
+        const std::string name = population.at("name").get<std::string>();
+        const std::set<std::string> traits = population.at("traits").get<std::set<std::string>>();
+        const size_t count = population.value("count", 1);
+        for (size_t i = 0; i < count; ++i) {
+            // Give up on a crowded map rather than searching forever.
+            size_t attempts = 0;
+            size_t y = rand_y(randgen);
+            size_t x = rand_x(randgen);
+            while (not ws.isPassable(y, x) and ++attempts < 1000) {
+                y = rand_y(randgen);
+                x = rand_x(randgen);
+            }
+            if (not ws.isPassable(y, x)) {
+                throw std::runtime_error("No room to place " + name + " in the scenario.");
+            }
+            placed.push_back(ws.addEntity(y, x, name, traits));
+        }
+    }
+    return placed;
+}
+
+void printPhase(const std::string& phase, std::chrono::duration<double> time, size_t ticks) {
+    std::cout<<std::setw(10)<<phase<<std::setw(12)<<std::fixed<<std::setprecision(3)<<
+        time.count() * 1000.0<<" ms"<<std::setw(12)<<std::setprecision(4)<<
+        time.count() * 1000.0 / ticks<<" ms/tick\n";
+}
+
+int main(int argc, char** argv) {
+    // Entity representations are utf8 encoded, so set up the same locale as the game.
+    if (nullptr == std::setlocale(LC_ALL, "en_US.utf8")) {
+        std::setlocale(LC_ALL, "C.UTF-8");
+    }
+
+    std::string scenario_path = "resources/sim_scenario.json";
+    if (2 <= argc) {
+        scenario_path = argv[1];
+    }
+    json scenario = loadScenario(scenario_path);
+    size_t ticks = scenario.value("ticks", 1000);
+    if (3 <= argc) {
+        ticks = std::stoul(argv[2]);
+    }
+
+    WorldState ws(scenario.value("height", 40), scenario.value("width", 80));
+    if (scenario.contains("active_chunk_radius")) {
+        ws.active_chunk_radius = scenario.at("active_chunk_radius").get<size_t>();
+    }
+    ws.suspend_directory = scenario.value("suspend_directory", "");
+    ws.seed = scenario.value("seed", 1u);
+    ws.initialize();
+    std::mt19937 randgen{scenario.value("seed", 1u)};
+    std::vector<EntityHandle> placed = populate(ws, scenario, randgen);
+
+    // Add command handlers for all of the scenario's entities.
+    const std::vector<Behavior::AbilitySet>& abilities = Behavior::getAbilities();
+    for (EntityHandle handle : placed) {
+        Entity& entity = ws.entities.at(handle);
+        for (const Behavior::AbilitySet& abset : abilities) {
+            abset.updateAvailable(entity);
+        }
+        // The player shouldn't have an automatic behavior set.
+        if (entity.traits.contains("player")) {
+            entity.behavior_set_name = "none";
+        }
+    }
+
+    CommandHandler comham;
+    ws.update();
+    ws.clearEvents();
+    const size_t start_entities = ws.entities.size();
+
+    Simulation::PhaseTimings timings;
+    std::chrono::duration<double> events{0};
+    size_t event_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        Simulation::tick(ws, comham, &timings);
+
+        // Render the events the player would see and then discard everything, as the game does.
+        auto events_start = std::chrono::steady_clock::now();
+        Entity* player = ws.entities.get(ws.findEntity(std::vector<std::string>{"player"}));
+        if (nullptr != player) {
+            event_count += ws.getLocalEvents(*player, player->stats.value().detectionRange()).size();
+        }
+        ws.clearEvents();
+        ws.tile_effects.clear();
+        events += std::chrono::steady_clock::now() - events_start;
+    }
+    std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+
+    std::cout<<"scenario  "<<scenario_path<<'\n';
+    std::cout<<"field     "<<ws.field_height<<"x"<<ws.field_width<<'\n';
+    std::cout<<"entities  "<<start_entities<<" at start, "<<ws.entities.size()<<" at end\n";
+    std::cout<<"chunks    "<<ws.residentChunks()<<" resident, "<<ws.suspendedChunks()<<" suspended\n";
+    std::cout<<"events    "<<event_count<<" seen by the player\n";
+    std::cout<<"ticks     "<<ticks<<" in "<<std::fixed<<std::setprecision(3)<<total.count()<<" s, "<<
+        std::setprecision(1)<<ticks / total.count()<<" ticks/s\n";
+    printPhase("behaviors", timings.behaviors, ticks);
+    printPhase("commands", timings.commands, ticks);
+    printPhase("update", timings.update, ticks);
+    printPhase("events", events, ticks);
+    return 0;
+}
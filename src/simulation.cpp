@@ -0,0 +1,64 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * The game tick pipeline, shared by the terminal game and the headless simulation.
+ */
+
+#include <algorithm>
+#include <execution>
+#include <map>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "behavior.hpp"
+#include "simulation.hpp"
+
+// Entities whose decisions are made together by one worker.
+constexpr size_t decision_block_size = 32;
+
+void Simulation::tick(WorldState& ws, CommandHandler& comham, PhaseTimings* timings) {
+    using clock = std::chrono::steady_clock;
+    auto phase_start = clock::now();
+
+    // Handle automated behaviors.
+    const std::map<std::string, Behavior::BehaviorSet>& behaviors = Behavior::getBehaviors();
+    std::vector<std::pair<const Entity*, const Behavior::BehaviorSet*>> actors;
+    for (const Entity& entity : ws.entities) {
+        auto behavior = behaviors.find(entity.behavior_set_name);
+        if (behavior != behaviors.end()) {
+            actors.push_back({&entity, &behavior->second});
+        }
+    }
+    // Decisions only read the world state, so blocks of entities decide in parallel, each block
+    // queueing into its own buffer. The buffers are merged in entity ID order.
+    const size_t num_blocks = (actors.size() + decision_block_size - 1) / decision_block_size;
+    std::vector<CommandBuffer> buffers(num_blocks);
+    std::vector<size_t> blocks(num_blocks);
+    std::iota(blocks.begin(), blocks.end(), 0);
+    std::for_each(std::execution::par, blocks.begin(), blocks.end(),
+        [&](size_t block) {
+            const size_t last = std::min(actors.size(), (block + 1) * decision_block_size);
+            for (size_t idx = block * decision_block_size; idx < last; ++idx) {
+                auto [entity, behavior] = actors[idx];
+                behavior->executeBehavior(*entity, ws, buffers[block]);
+            }
+        });
+    comham.enqueueBuffers(buffers);
+    auto behaviors_end = clock::now();
+
+    // Execute all commands every tick.
+    comham.executeCommands(ws);
+    auto commands_end = clock::now();
+
+    // Tick update
+    ws.update();
+    auto update_end = clock::now();
+
+    if (nullptr != timings) {
+        timings->behaviors += behaviors_end - phase_start;
+        timings->commands += commands_end - behaviors_end;
+        timings->update += update_end - commands_end;
+    }
+}
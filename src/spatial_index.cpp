@@ -0,0 +1,49 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * A uniform grid of cells that buckets entities by location so that range queries only need to
+ * look at the entities that are near the query location.
+ */
+
+#include <algorithm>
+
+#include "spatial_index.hpp"
+
+SpatialIndex::SpatialIndex(size_t field_height, size_t field_width, size_t cell_size) :
+    field_height(field_height), field_width(field_width), cell_size(std::max<size_t>(1, cell_size)) {
+    cells_wide = (field_width + this->cell_size - 1) / this->cell_size;
+    size_t cells_high = (field_height + this->cell_size - 1) / this->cell_size;
+    cells.resize(cells_wide * cells_high);
+}
+
+size_t SpatialIndex::cellIndex(size_t y, size_t x) const {
+    return (y / cell_size) * cells_wide + (x / cell_size);
+}
+
+void SpatialIndex::eraseFromCell(size_t cell_idx, EntityHandle entity) {
+    std::vector<EntityHandle>& cell = cells.at(cell_idx);
+    auto found = std::find(cell.begin(), cell.end(), entity);
+    if (found != cell.end()) {
+        // Order within a cell does not matter, so swap with the back rather than shifting.
+        *found = cell.back();
+        cell.pop_back();
+    }
+}
+
+void SpatialIndex::insert(EntityHandle entity, size_t y, size_t x) {
+    cells.at(cellIndex(y, x)).push_back(entity);
+}
+
+void SpatialIndex::erase(EntityHandle entity, size_t y, size_t x) {
+    eraseFromCell(cellIndex(y, x), entity);
+}
+
+void SpatialIndex::move(EntityHandle entity, size_t old_y, size_t old_x, size_t y, size_t x) {
+    size_t old_cell = cellIndex(old_y, old_x);
+    size_t new_cell = cellIndex(y, x);
+    // Most moves are a single step and stay within the same cell.
+    if (old_cell != new_cell) {
+        eraseFromCell(old_cell, entity);
+        cells.at(new_cell).push_back(entity);
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * An index from traits to the entities that have them, so that commands and searches for a trait
+ * only visit the matching entities instead of every entity in the world.
+ */
+
+#include <stdexcept>
+#include <string>
+
+#include "trait_index.hpp"
+
+void TraitIndex::insert(EntityHandle entity, const TraitSet& traits) {
+    if (positions.size() <= entity.slot) {
+        positions.resize(entity.slot + 1);
+    }
+    std::vector<std::pair<TraitId, uint32_t>>& entity_positions = positions[entity.slot];
+    entity_positions.clear();
+    for (TraitId trait : traits.ids()) {
+        if (entities.size() <= trait) {
+            entities.resize(trait + 1);
+        }
+        entity_positions.push_back({trait, static_cast<uint32_t>(entities[trait].size())});
+        entities[trait].push_back(entity);
+    }
+}
+
+uint32_t& TraitIndex::positionOf(EntityHandle entity, TraitId trait) {
+    // Entities only have a handful of traits, so a linear search is quick.
+    for (auto& [entity_trait, position] : positions[entity.slot]) {
+        if (entity_trait == trait) {
+            return position;
+        }
+    }
+    throw std::logic_error("Entity is not indexed under trait " + std::to_string(trait));
+}
+
+void TraitIndex::erase(EntityHandle entity) {
+    if (entity.slot >= positions.size()) {
+        return;
+    }
+    for (auto [trait, position] : positions[entity.slot]) {
+        std::vector<EntityHandle>& with_trait = entities[trait];
+        if (position >= with_trait.size() or with_trait[position] != entity) {
+            continue;
+        }
+        // Order does not matter, so swap with the back rather than shifting.
+        EntityHandle moved = with_trait.back();
+        with_trait[position] = moved;
+        with_trait.pop_back();
+        if (moved != entity) {
+            positionOf(moved, trait) = position;
+        }
+    }
+    positions[entity.slot].clear();
+}
+
+const std::vector<EntityHandle>& TraitIndex::entitiesWith(TraitId trait) const {
+    static const std::vector<EntityHandle> nothing;
+    if (trait >= entities.size()) {
+        return nothing;
+    }
+    return entities[trait];
+}
+
+const std::vector<EntityHandle>& TraitIndex::candidates(const TraitQuery& query) const {
+    static const std::vector<EntityHandle> nothing;
+    if (not query.satisfiable) {
+        return nothing;
+    }
+    const std::vector<EntityHandle>* shortest = nullptr;
+    for (TraitId trait : query.required.ids()) {
+        const std::vector<EntityHandle>& with_trait = entitiesWith(trait);
+        if (nullptr == shortest or with_trait.size() < shortest->size()) {
+            shortest = &with_trait;
+        }
+    }
+    return nullptr == shortest ? nothing : *shortest;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2022 Bernhard Firner
+ *
+ * Interned entity traits. Every trait string is assigned a small integer ID when it is first seen,
+ * and entities hold their traits as a bitmask of those IDs so that trait checks are bit tests
+ * instead of string comparisons.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "trait_set.hpp"
+
+namespace {
+    struct TraitRegistry {
+        std::vector<std::string> names;
+        std::unordered_map<std::string, TraitId> ids;
+
+        TraitRegistry() {
+            // Traits that the engine itself checks are interned first so that they always fit into
+            // the inline bits.
+            for (const char* trait : {"player", "mob", "auto", "aggro", "impassable", "small", "flying"}) {
+                ids.insert({trait, names.size()});
+                names.push_back(trait);
+            }
+        }
+    };
+
+    TraitRegistry& registry() {
+        static TraitRegistry traits;
+        return traits;
+    }
+}
+
+TraitId Traits::intern(const std::string& trait) {
+    TraitRegistry& traits = registry();
+    auto [location, inserted] = traits.ids.insert({trait, traits.names.size()});
+    if (inserted) {
+        traits.names.push_back(trait);
+    }
+    return location->second;
+}
+
+bool Traits::find(const std::string& trait, TraitId& id) {
+    const TraitRegistry& traits = registry();
+    auto location = traits.ids.find(trait);
+    if (location == traits.ids.end()) {
+        return false;
+    }
+    id = location->second;
+    return true;
+}
+
+const std::string& Traits::name(TraitId id) {
+    const TraitRegistry& traits = registry();
+    if (id >= traits.names.size()) {
+        throw std::out_of_range("Unknown trait ID " + std::to_string(id));
+    }
+    return traits.names[id];
+}
+
+bool TraitSet::contains(const std::string& trait) const {
+    TraitId id;
+    return Traits::find(trait, id) and contains(id);
+}
+
+void TraitSet::insert(TraitId id) {
+    if (id < inline_traits) {
+        bits[id / 64] |= uint64_t{1} << (id % 64);
+    }
+    else {
+        auto location = std::lower_bound(overflow.begin(), overflow.end(), id);
+        if (location == overflow.end() or *location != id) {
+            overflow.insert(location, id);
+        }
+    }
+}
+
+void TraitSet::insert(const std::string& trait) {
+    insert(Traits::intern(trait));
+}
+
+void TraitSet::erase(TraitId id) {
+    if (id < inline_traits) {
+        bits[id / 64] &= ~(uint64_t{1} << (id % 64));
+    }
+    else {
+        auto location = std::lower_bound(overflow.begin(), overflow.end(), id);
+        if (location != overflow.end() and *location == id) {
+            overflow.erase(location);
+        }
+    }
+}
+
+void TraitSet::erase(const std::string& trait) {
+    TraitId id;
+    if (Traits::find(trait, id)) {
+        erase(id);
+    }
+}
+
+bool TraitSet::empty() const {
+    return overflow.empty() and std::all_of(bits.begin(), bits.end(), [](uint64_t word) {return 0 == word;});
+}
+
+std::vector<std::string> TraitSet::names() const {
+    std::vector<std::string> trait_names;
+    for (size_t word = 0; word < inline_words; ++word) {
+        // Visit only the set bits, lowest first.
+        for (uint64_t remaining = bits[word]; 0 != remaining; remaining &= remaining - 1) {
+            trait_names.push_back(Traits::name(word * 64 + std::countr_zero(remaining)));
+        }
+    }
+    for (TraitId id : overflow) {
+        trait_names.push_back(Traits::name(id));
+    }
+    return trait_names;
+}
+
+std::vector<TraitId> TraitSet::ids() const {
+    std::vector<TraitId> trait_ids;
+    for (size_t word = 0; word < inline_words; ++word) {
+        for (uint64_t remaining = bits[word]; 0 != remaining; remaining &= remaining - 1) {
+            trait_ids.push_back(word * 64 + std::countr_zero(remaining));
+        }
+    }
+    trait_ids.insert(trait_ids.end(), overflow.begin(), overflow.end());
+    return trait_ids;
+}
+
+bool TraitSet::containsOverflow(TraitId id) const {
+    return std::binary_search(overflow.begin(), overflow.end(), id);
+}
+
+bool TraitSet::containsAllOverflow(const TraitSet& other) const {
+    return std::includes(overflow.begin(), overflow.end(), other.overflow.begin(), other.overflow.end());
+}
+
+bool TraitSet::containsAnyOverflow(const TraitSet& other) const {
+    return std::any_of(other.overflow.begin(), other.overflow.end(),
+        [&](TraitId id) {return containsOverflow(id);});
+}
+
+TraitQuery::TraitQuery(const std::vector<std::string>& traits) {
+    for (const std::string& trait : traits) {
+        TraitId id;
+        if (Traits::find(trait, id)) {
+            required.insert(id);
+        }
+        else {
+            satisfiable = false;
+        }
+    }
+}
@@ -277,35 +277,37 @@ short UserInterface::getEntityColor(const Entity& ent, const std::string& bg_col
     return Colors::white_on_black;
 }
 
-void UserInterface::updateDisplay(WINDOW* window, const std::list<Entity>& entities,
-        const std::map<std::tuple<size_t, size_t>, std::string>& background_effects) {
+void UserInterface::updateDisplay(WINDOW* window, const EntityStore& entities,
+        const EffectLayer& effects) {
     // Store the original colors so that they can be easily restored.
     attr_t orig_attrs;
     short orig_color;
     wattr_get(window, &orig_attrs, &orig_color, nullptr);
     werase(window);
     // Print all of the entities then add in effects. Don't let an effect overwrite an entity.
-    std::set<std::tuple<size_t, size_t>> drawn;
+    std::vector<bool> drawn(effects.height() * effects.width(), false);
     for (const Entity& ent : entities) {
-        auto location = std::make_tuple(ent.y, ent.x);
-        if (not background_effects.contains(location)) {
+        TileEffect effect = effects.at(ent.y, ent.x);
+        if (TileEffect::none == effect) {
             wattr_set(window, getEntityAttr(ent), getEntityColor(ent), nullptr);
         }
         else {
-            wattr_set(window, getEntityAttr(ent), getEntityColor(ent, background_effects.at(location)), nullptr);
+            wattr_set(window, getEntityAttr(ent), getEntityColor(ent, effectColor(effect)), nullptr);
         }
         //mvwaddch(window, ent.y, ent.x, getEntityChar(ent));
         drawString(window, getEntityChar(ent), ent.y, ent.x);
 
-        drawn.insert({ent.y, ent.x});
+        if (ent.y < effects.height() and ent.x < effects.width()) {
+            drawn[ent.y * effects.width() + ent.x] = true;
+        }
     }
     // Now draw the background effects for any locations not already drawn.
-    for (auto& [location, color] : background_effects) {
-        if (not drawn.contains(location)) {
-            wattr_set(window, A_NORMAL, std::get<1>(strToAttrCode("white on " + color)), nullptr);
-            drawString(window, " ", std::get<0>(location), std::get<1>(location));
+    effects.forEachMarked([&](size_t y, size_t x, TileEffect effect) {
+        if (not drawn[y * effects.width() + x]) {
+            wattr_set(window, A_NORMAL, std::get<1>(strToAttrCode(std::string("white on ") + effectColor(effect))), nullptr);
+            drawString(window, " ", y, x);
         }
-    }
+    });
     // Back to the original setting
     wattr_set(window, orig_attrs, orig_color, nullptr);
 }
@@ -405,7 +407,7 @@ void drawBar(WINDOW* window, double percent) {
     wattr_set(window, orig_attrs, orig_color, nullptr);
 }
 
-size_t UserInterface::drawStatus(WINDOW* window, const Entity& entity, size_t row, size_t column) {
+size_t UserInterface::drawStatus(WINDOW* window, const Entity& entity, uint64_t world_seed, size_t row, size_t column) {
     werase(window);
     // TODO This should just be a specialization of UIComponent so there isn't hidden knowledge
     // inside of the function.
@@ -474,7 +476,7 @@ size_t UserInterface::drawStatus(WINDOW* window, const Entity& entity, size_t ro
     // TODO Classes
     wmove(window, cur_row++, column);
     drawString(window, "Description:");
-    std::string description = entity.getDescription();
+    std::string description = entity.getDescription(world_seed);
     wmove(window, cur_row, column);
     drawString(window, std::string(28, ' '));
     wmove(window, cur_row, column);
@@ -6,96 +6,233 @@
 
 #include <algorithm>
 #include <cmath>
-#include <execution>
+#include <fstream>
 #include <functional>
 #include <set>
 #include <optional>
-#include <regex>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "entity.hpp"
+#include "entity_serialization.hpp"
 #include "lore.hpp"
+#include "olympos_utility.hpp"
+#include "trait_set.hpp"
 #include "world_state.hpp"
 
 using std::vector;
 
 bool isPassable(const Entity& entity) {
+    static const TraitId impassable = Traits::intern("impassable");
+    static const TraitId mob = Traits::intern("mob");
+    static const TraitId small = Traits::intern("small");
+    static const TraitId flying = Traits::intern("flying");
     // Passable if this is not impassible or a non-small, non-flying mob.
-    return not (entity.traits.contains("impassable") or
-        (entity.traits.contains("mob") and
-         not entity.traits.contains("small") and
-         not entity.traits.contains("flying")));
+    return not (entity.traits.contains(impassable) or
+        (entity.traits.contains(mob) and
+         not entity.traits.contains(small) and
+         not entity.traits.contains(flying)));
 
 }
 
-// TODO This may not be the way, but it will work out for now.
-void initializePassable(const std::list<Entity>& entities, vector<vector<bool>>& passable) {
-    // Set everything passable and then update things that are not.
-    for (auto& row : passable) {
-        row.assign(true, row.size());
+void WorldState::updateBlockers(const Entity& entity, size_t y, size_t x, int delta) {
+    if (::isPassable(entity)) {
+        return;
     }
-    for (auto& entity_p : entities) {
-        if (not isPassable(entity_p)) {
-            passable[entity_p.y][entity_p.x] = false;
+    TileChunk& chunk = chunks.obtain(chunks.chunkOf(y, x));
+    size_t offset = chunks.offsetOf(y, x);
+    chunk.blockers[offset] += delta;
+    chunk.blocked[offset] = 0 != chunk.blockers[offset];
+    static const TraitId impassable = Traits::intern("impassable");
+    if (entity.traits.contains(impassable)) {
+        chunk.terrain_blockers[offset] += delta;
+        bool terrain_blocked = 0 != chunk.terrain_blockers[offset];
+        if (terrain_blocked != chunk.terrain_blocked[offset]) {
+            chunk.terrain_blocked[offset] = terrain_blocked;
+            terrain_version += 1;
         }
     }
 }
 
+void WorldState::addToChunk(EntityHandle handle, size_t chunk) {
+    std::vector<EntityHandle>& chunk_entities = chunks.obtain(chunk).entities;
+    if (chunk_positions.size() <= handle.slot) {
+        chunk_positions.resize(handle.slot + 1);
+    }
+    chunk_positions[handle.slot] = chunk_entities.size();
+    chunk_entities.push_back(handle);
+}
+
+void WorldState::removeFromChunk(EntityHandle handle, size_t chunk) {
+    std::vector<EntityHandle>& chunk_entities = chunks.find(chunk)->entities;
+    EntityHandle moved = chunk_entities.back();
+    chunk_entities[chunk_positions[handle.slot]] = moved;
+    chunk_positions[moved.slot] = chunk_positions[handle.slot];
+    chunk_entities.pop_back();
+}
+
+RandomStream& WorldState::randomStream(const Entity& entity, RandomStream::Purpose purpose) {
+    return random_streams.try_emplace({entity.entity_id, purpose}, seed, entity.entity_id, cur_tick, purpose).first->second;
+}
 
-bool WorldState::isPassable(size_t y, size_t x) {
+bool WorldState::isPassable(size_t y, size_t x) const {
     // Out of bounds? Return false.
     if (y >= this->field_height or x >= this->field_width) {
         return false;
     }
-    // Return false if given location is not passable.
-    if (not passable[y][x]) {
+    size_t chunk_idx = chunks.chunkOf(y, x);
+    if (suspended[chunk_idx]) {
         return false;
     }
-    // Otherwise return true.
-    return true;
+    // Chunks without storage have never held an entity, so nothing blocks them.
+    const TileChunk* chunk = chunks.find(chunk_idx);
+    return nullptr == chunk or not chunk->blocked[chunks.offsetOf(y, x)];
+}
+
+bool WorldState::isPassableTerrain(size_t y, size_t x) const {
+    if (y >= this->field_height or x >= this->field_width) {
+        return false;
+    }
+    size_t chunk_idx = chunks.chunkOf(y, x);
+    if (suspended[chunk_idx]) {
+        return false;
+    }
+    const TileChunk* chunk = chunks.find(chunk_idx);
+    return nullptr == chunk or not chunk->terrain_blocked[chunks.offsetOf(y, x)];
+}
+
+uint64_t WorldState::terrainVersion() const {
+    return terrain_version;
+}
+
+const FlowField& WorldState::flowField(const std::string& target) {
+    auto field = flow_fields.find(target);
+    if (field == flow_fields.end()) {
+        field = flow_fields.try_emplace(target, 0, FlowField(field_height, field_width)).first;
+    }
+    else if (field->second.first == cur_tick) {
+        return field->second.second;
+    }
+    field->second.first = cur_tick;
+
+    // Targets are matched the same way as findEntity matches them, by trait or by name.
+    std::vector<std::pair<size_t, size_t>> goals;
+    TraitQuery query(std::vector<std::string>{target});
+    if (query.satisfiable and not query.required.empty()) {
+        for (EntityHandle handle : trait_index.candidates(query)) {
+            const Entity* entity = entities.get(handle);
+            if (nullptr != entity and query.matches(entity->traits)) {
+                goals.push_back({entity->y, entity->x});
+            }
+        }
+    }
+    for (EntityHandle handle : name_index.find(target)) {
+        if (const Entity* entity = entities.get(handle)) {
+            goals.push_back({entity->y, entity->x});
+        }
+    }
+    field->second.second.compute(goals, flow_field_distance,
+        [this](size_t y, size_t x) {return isPassableTerrain(y, x);});
+    return field->second.second;
 }
 
 WorldState::WorldState(size_t field_height, size_t field_width) :
-    passable{field_height, vector<bool>(field_width, true)} {
+    chunks(field_height, field_width),
+    spatial_index{field_height, field_width},
+    tile_effects{field_height, field_width} {
     this->field_height = field_height;
     this->field_width = field_width;
+    event_regions_wide = (field_width + event_region_size - 1) / event_region_size;
+    size_t event_regions_high = (field_height + event_region_size - 1) / event_region_size;
+    event_regions.resize(event_regions_wide * event_regions_high);
+    suspended.resize(chunks.chunksWide() * chunks.chunksHigh(), false);
 }
 
-void WorldState::addEntity(size_t y, size_t x, const std::string& name, const std::set<std::string>& traits) {
+size_t WorldState::residentChunks() const {
+    return chunks.allocatedChunks().size();
+}
+
+size_t WorldState::suspendedChunks() const {
+    return suspended_count;
+}
+
+EntityHandle WorldState::addEntity(size_t y, size_t x, const std::string& name, const std::set<std::string>& traits) {
     if (y >= this->field_height or x >= this->field_width) {
         throw std::runtime_error("Cannot place entity at "+std::to_string(y)+", "+std::to_string(x)+": out of bounds.");
     }
+    // Bring back the rest of the chunk so that the new entity does not end up in a frozen area.
+    if (suspended[chunks.chunkOf(y, x)]) {
+        resumeChunk(chunks.chunkOf(y, x));
+    }
     // TODO FIXME Make a real constructor for the Entity class
-    entities.push_front(Entity(y, x, name, traits));
+    EntityHandle handle = entities.insert(Entity(y, x, name, traits));
+    indexEntity(handle);
 
     // Calculate starting stats for this entity (if it has any)
     /*
-    std::optional<Stats> stats = OlymposLore::getStats(entities.front());
+    std::optional<Stats> stats = OlymposLore::getStats(entities.at(handle));
     if (stats) {
-        entities.front().stats = stats.value();
+        entities.at(handle).stats = stats.value();
     }
     */
+    return handle;
 }
 
-bool passableOrNotPresent(size_t y, size_t x, const Entity& ent) {
-    return ent.y != y or ent.x != x or isPassable(ent);
+void WorldState::indexEntity(EntityHandle handle) {
+    const Entity& entity = entities.at(handle);
+    updateBlockers(entity, entity.y, entity.x, 1);
+    addToChunk(handle, chunks.chunkOf(entity.y, entity.x));
+    spatial_index.insert(handle, entity.y, entity.x);
+    name_index.insert(handle, entity.name);
+    trait_index.insert(handle, entity.traits);
+    perception.entityChanged(entity);
+    if (entity.stats) {
+        regen_table.set(handle, entity.stats.value());
+    }
 }
 
-void WorldState::updatePassable(size_t y, size_t x) {
-    passable[y][x] = std::all_of(
-        std::execution::par_unseq, entities.begin(), entities.end(),
-        std::bind_front(passableOrNotPresent, y, x));
+void WorldState::insertEntity(Entity&& entity) {
+    if (entity.y >= this->field_height or entity.x >= this->field_width) {
+        throw std::runtime_error("Cannot place entity at "+std::to_string(entity.y)+", "+std::to_string(entity.x)+": out of bounds.");
+    }
+    // Inserting into the store could relocate entities that running commands hold references to.
+    pending_entities.push_back(std::move(entity));
+}
+
+void WorldState::removeEntity(EntityHandle handle) {
+    Entity* entity = entities.get(handle);
+    if (nullptr == entity) {
+        return;
+    }
+    updateBlockers(*entity, entity->y, entity->x, -1);
+    removeFromChunk(handle, chunks.chunkOf(entity->y, entity->x));
+    spatial_index.erase(handle, entity->y, entity->x);
+    name_index.erase(handle, entity->name);
+    trait_index.erase(handle);
+    regen_table.erase(handle);
+    perception.entityChanged(*entity);
+    pathfinder.forget(entity->entity_id);
+    // Events logged this tick may still refer to the entity.
+    departed_names[entity->entity_id] = entity->name;
+    // The storage is reclaimed during update so that references to other entities stay valid.
+    entities.retire(handle);
 }
 
 bool WorldState::moveEntity(Entity& entity, size_t y, size_t x) {
     // Out of bounds? Return false.
-    if (y >= this->field_height or x >= this->field_height) {
+    if (y >= this->field_height or x >= this->field_width) {
         return false;
     }
     // Return false if the entity cannot move to the given location.
-    if (not passable[y][x]) {
+    if (not isPassable(y, x)) {
+        return false;
+    }
+
+    // Entities removed earlier in the tick are no longer in the world, so they cannot move.
+    EntityHandle handle = entities.handleOf(entity);
+    if (not entities.contains(handle)) {
         return false;
     }
 
@@ -104,32 +241,48 @@ bool WorldState::moveEntity(Entity& entity, size_t y, size_t x) {
     size_t old_x = entity.x;
     entity.y = y;
     entity.x = x;
+    spatial_index.move(handle, old_y, old_x, y, x);
+    size_t old_chunk = chunks.chunkOf(old_y, old_x);
+    size_t new_chunk = chunks.chunkOf(y, x);
+    if (old_chunk != new_chunk) {
+        removeFromChunk(handle, old_chunk);
+        addToChunk(handle, new_chunk);
+    }
 
-    // Update passable with this entity removed.
-    updatePassable(old_y, old_x);
-
-    // Now update passable at the new location.
-    updatePassable(y, x);
+    // Only the two tiles involved in the move change, so adjust their blocker counts directly.
+    updateBlockers(entity, old_y, old_x, -1);
+    updateBlockers(entity, y, x, 1);
     return true;
 }
 
-void WorldState::damageEntity(decltype(entities)::iterator entity_i, size_t damage, Entity&) {
+void WorldState::setStats(EntityHandle handle, const std::optional<Stats>& stats) {
+    Entity* entity = entities.get(handle);
+    if (nullptr == entity) {
+        return;
+    }
+    entity->stats = stats;
+    if (entity->stats) {
+        regen_table.set(handle, entity->stats.value());
+    }
+    else {
+        regen_table.erase(handle);
+    }
+}
+
+void WorldState::damageEntity(EntityHandle handle, size_t damage, Entity&) {
     // TODO Attacking entity is not currently used.
-    // Out of bounds, nothing happens.
-    if (entities.end() == entity_i) {
+    Entity* entity = entities.get(handle);
+    // The entity no longer exists, nothing happens.
+    if (nullptr == entity) {
         return;
     }
 
-    if (entity_i->stats) {
-        Stats& stats = entity_i->stats.value();
+    if (entity->stats) {
+        Stats& stats = entity->stats.value();
         if (damage >= stats.health) {
             stats.health = 0;
             // Remove the entity.
-            // Remember its location and update the passable information after the removal.
-            size_t entity_y = entity_i->y;
-            size_t entity_x = entity_i->x;
-            entities.erase(entity_i);
-            updatePassable(entity_y, entity_x);
+            removeEntity(handle);
             // TODO FIXME Remove all of its actions from the action queue.
             // That implies that the action queue should be part of the world model.
             // Makes sense, the action log should live in the world model as well.
@@ -140,46 +293,252 @@ void WorldState::damageEntity(decltype(entities)::iterator entity_i, size_t dama
     }
 }
 
-std::list<Entity>::iterator WorldState::findEntity(const std::string& name) {
-    std::regex pattern(name, std::regex_constants::icase);
-    return std::find_if(entities.begin(), entities.end(),
-        [&](Entity& ent) {return std::regex_search(ent.name, pattern);});
+EntityHandle WorldState::findEntity(const std::string& name) {
+    // Take the lowest entity ID among the matches so the result does not depend upon storage order.
+    EntityHandle found;
+    const Entity* found_entity = nullptr;
+    for (EntityHandle handle : name_index.find(name)) {
+        const Entity* entity = entities.get(handle);
+        if (nullptr != entity and (nullptr == found_entity or entity->entity_id < found_entity->entity_id)) {
+            found = handle;
+            found_entity = entity;
+        }
+    }
+    return found;
 }
 
-std::list<Entity>::iterator WorldState::findEntity(const std::vector<std::string>& traits) {
-    return std::find_if(entities.begin(), entities.end(),
-        [&](Entity& ent) {return std::all_of(traits.begin(), traits.end(), [&](const std::string& trait) {return ent.traits.contains(trait);});});
+bool hasAllTraits(const TraitQuery& query, const Entity& ent) {
+    return query.matches(ent.traits);
 }
 
-std::list<Entity>::iterator WorldState::findEntity(const std::string& name, int64_t y, int64_t x, size_t range) {
-    std::regex pattern(name, std::regex_constants::icase);
-    return std::find_if(entities.begin(), entities.end(),
-        [&](Entity& ent) {return std::regex_search(ent.name, pattern) and (abs(y - ent.y) + abs(x - ent.x)) <= (int64_t)range;});
+EntityHandle WorldState::findEntity(const std::vector<std::string>& traits) {
+    // Take the lowest entity ID among the matches. Removal reorders the storage, so the first
+    // match in storage order would depend upon which entities were removed earlier.
+    TraitQuery query(traits);
+    EntityHandle found;
+    const Entity* found_entity = nullptr;
+    auto consider = [&](EntityHandle handle, const Entity& entity) {
+        if (query.matches(entity.traits) and (nullptr == found_entity or entity.entity_id < found_entity->entity_id)) {
+            found = handle;
+            found_entity = &entity;
+        }
+    };
+    // A query without required traits has no index entry to start from, so every entity is checked.
+    if (query.required.empty()) {
+        for (const Entity& entity : entities) {
+            consider(entities.handleOf(entity), entity);
+        }
+        return found;
+    }
+    for (EntityHandle handle : trait_index.candidates(query)) {
+        const Entity* entity = entities.get(handle);
+        if (nullptr != entity) {
+            consider(handle, *entity);
+        }
+    }
+    return found;
 }
 
-bool hasAllTraits(const std::vector<std::string>& traits, const Entity& ent) {
-    return std::all_of(traits.begin(), traits.end(), [&](const std::string& trait) {return ent.traits.contains(trait);});
+std::vector<EntityHandle> WorldState::findAllEntities(const std::vector<std::string>& traits) {
+    TraitQuery query(traits);
+    std::vector<std::pair<size_t, EntityHandle>> found_entities;
+    if (query.required.empty()) {
+        for (const Entity& entity : entities) {
+            if (query.matches(entity.traits)) {
+                found_entities.push_back({entity.entity_id, entities.handleOf(entity)});
+            }
+        }
+    }
+    else {
+        for (EntityHandle handle : trait_index.candidates(query)) {
+            const Entity* entity = entities.get(handle);
+            if (nullptr != entity and query.matches(entity->traits)) {
+                found_entities.push_back({entity->entity_id, handle});
+            }
+        }
+    }
+    std::sort(found_entities.begin(), found_entities.end(),
+        [](const auto& a, const auto& b) {return a.first < b.first;});
+    std::vector<EntityHandle> handles;
+    handles.reserve(found_entities.size());
+    for (auto& [entity_id, handle] : found_entities) {
+        handles.push_back(handle);
+    }
+    return handles;
+}
+
+template<typename Predicate>
+EntityHandle WorldState::findNearest(int64_t y, int64_t x, size_t range, Predicate&& predicate) {
+    EntityHandle nearest;
+    const Entity* nearest_entity = nullptr;
+    size_t nearest_distance = 0;
+    spatial_index.forEachNear(y, x, range,
+        [&](EntityHandle handle) {
+            const Entity* entity = entities.get(handle);
+            if (nullptr == entity) {
+                return;
+            }
+            size_t distance = OlymposUtility::manhattanDistance(y, x, entity->y, entity->x);
+            if (distance > range) {
+                return;
+            }
+            bool closer = nullptr == nearest_entity or distance < nearest_distance or
+                (distance == nearest_distance and entity->entity_id < nearest_entity->entity_id);
+            if (closer and predicate(handle, *entity)) {
+                nearest = handle;
+                nearest_entity = entity;
+                nearest_distance = distance;
+            }
+        });
+    return nearest;
+}
+
+EntityHandle WorldState::findEntity(const std::string& name, int64_t y, int64_t x, size_t range) {
+    std::vector<EntityHandle> named = name_index.find(name);
+    if (named.empty()) {
+        return {};
+    }
+    // With only a few candidates it is cheaper to check them directly than to visit the area.
+    if (named.size() <= 32) {
+        EntityHandle nearest;
+        const Entity* nearest_entity = nullptr;
+        size_t nearest_distance = 0;
+        for (EntityHandle handle : named) {
+            const Entity* entity = entities.get(handle);
+            if (nullptr == entity) {
+                continue;
+            }
+            size_t distance = OlymposUtility::manhattanDistance(y, x, entity->y, entity->x);
+            if (distance <= range and (nullptr == nearest_entity or distance < nearest_distance or
+                (distance == nearest_distance and entity->entity_id < nearest_entity->entity_id))) {
+                nearest = handle;
+                nearest_entity = entity;
+                nearest_distance = distance;
+            }
+        }
+        return nearest;
+    }
+    // The candidates are sorted by slot, and slots identify live entities uniquely.
+    return findNearest(y, x, range,
+        [&](EntityHandle handle, const Entity&) {
+            return std::binary_search(named.begin(), named.end(), handle,
+                [](const EntityHandle& a, const EntityHandle& b) {return a.slot < b.slot;});
+        });
 }
 
-std::list<Entity>::iterator WorldState::findEntity(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range) {
-    auto trait_check = std::bind_front(hasAllTraits, traits);
-    return std::find_if(entities.begin(), entities.end(),
-        [&](Entity& ent) {return trait_check(ent) and (abs(y - ent.y) + abs(x - ent.x)) <= (int64_t)range;});
+EntityHandle WorldState::findEntity(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range) {
+    return findEntity(TraitQuery(traits), y, x, range);
 }
 
-std::list<Entity>::iterator WorldState::findEntity(size_t entity_id) {
-    return std::find(entities.begin(), entities.end(), entity_id);
+EntityHandle WorldState::findEntity(const TraitQuery& query, int64_t y, int64_t x, size_t range) {
+    if (not query.satisfiable) {
+        return {};
+    }
+    return findNearest(y, x, range,
+        [&](EntityHandle, const Entity& ent) {return query.matches(ent.traits);});
 }
 
-std::vector<std::list<Entity>::iterator> WorldState::findEntities(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range) {
-    auto trait_check = std::bind_front(hasAllTraits, traits);
-    std::vector<std::list<Entity>::iterator> found_entities;
-    for (std::list<Entity>::iterator entity_i = entities.begin(); entity_i != entities.end(); ++entity_i) {
-        if (trait_check(*entity_i) and (abs(y - entity_i->y) + abs(x - entity_i->x)) <= (int64_t)range) {
-            found_entities.push_back(entity_i);
+EntityHandle WorldState::nearestCandidate(const Perception::Candidates& candidates, int64_t y, int64_t x, size_t range) {
+    // Same tie breaking as findNearest.
+    EntityHandle nearest;
+    const Entity* nearest_entity = nullptr;
+    size_t nearest_distance = 0;
+    for (EntityHandle handle : candidates.handles) {
+        const Entity* entity = entities.get(handle);
+        if (nullptr == entity) {
+            continue;
+        }
+        size_t distance = OlymposUtility::manhattanDistance(y, x, entity->y, entity->x);
+        if (distance <= range and (nullptr == nearest_entity or distance < nearest_distance or
+            (distance == nearest_distance and entity->entity_id < nearest_entity->entity_id))) {
+            nearest = handle;
+            nearest_entity = entity;
+            nearest_distance = distance;
         }
     }
-    return found_entities;
+    return nearest;
+}
+
+EntityHandle WorldState::perceiveTrait(const std::string& trait, int64_t y, int64_t x, size_t range) {
+    return perceiveTraits(TraitQuery(std::vector<std::string>{trait}), y, x, range);
+}
+
+EntityHandle WorldState::perceiveTraits(const TraitQuery& query, int64_t y, int64_t x, size_t range) {
+    if (not query.satisfiable) {
+        return {};
+    }
+    const Perception::Candidates* candidates = perception.recall(query);
+    if (nullptr == candidates) {
+        Perception::Candidates gathered;
+        // A query without traits matches everything, which is too many to remember.
+        if (query.required.empty()) {
+            gathered.too_many = true;
+        }
+        else {
+            for (EntityHandle handle : trait_index.candidates(query)) {
+                const Entity* entity = entities.get(handle);
+                if (nullptr != entity and query.matches(entity->traits)) {
+                    gathered.handles.push_back(handle);
+                    if (gathered.handles.size() > Perception::max_candidates) {
+                        break;
+                    }
+                }
+            }
+        }
+        if (gathered.handles.size() > Perception::max_candidates) {
+            gathered.handles.clear();
+            gathered.too_many = true;
+        }
+        candidates = &perception.remember(query, std::move(gathered));
+    }
+    if (candidates->too_many) {
+        return findEntity(query, y, x, range);
+    }
+    return nearestCandidate(*candidates, y, x, range);
+}
+
+EntityHandle WorldState::perceiveName(const std::string& name, int64_t y, int64_t x, size_t range) {
+    const Perception::Candidates* candidates = perception.recall(name);
+    if (nullptr == candidates) {
+        Perception::Candidates gathered;
+        gathered.handles = name_index.find(name);
+        if (gathered.handles.size() > Perception::max_candidates) {
+            gathered.handles.clear();
+            gathered.too_many = true;
+        }
+        candidates = &perception.remember(name, std::move(gathered));
+    }
+    if (candidates->too_many) {
+        return findEntity(name, y, x, range);
+    }
+    return nearestCandidate(*candidates, y, x, range);
+}
+
+EntityHandle WorldState::findEntity(size_t entity_id) {
+    return entities.find(entity_id);
+}
+
+std::vector<EntityHandle> WorldState::findEntities(const std::vector<std::string>& traits, int64_t y, int64_t x, size_t range) {
+    TraitQuery query(traits);
+    auto trait_check = std::bind_front(hasAllTraits, std::cref(query));
+    std::vector<std::pair<size_t, EntityHandle>> found_entities;
+    spatial_index.forEachNear(y, x, range,
+        [&](EntityHandle handle) {
+            const Entity* entity = entities.get(handle);
+            if (nullptr != entity and
+                OlymposUtility::manhattanDistance(y, x, entity->y, entity->x) <= range and trait_check(*entity)) {
+                found_entities.push_back({entity->entity_id, handle});
+            }
+        });
+    // Keep results in a stable order regardless of how the entities are bucketed.
+    std::sort(found_entities.begin(), found_entities.end(),
+        [](const auto& a, const auto& b) {return a.first < b.first;});
+    std::vector<EntityHandle> handles;
+    handles.reserve(found_entities.size());
+    for (auto& [entity_id, handle] : found_entities) {
+        handles.push_back(handle);
+    }
+    return handles;
 }
 
 void WorldState::initialize() {
@@ -203,8 +562,6 @@ void WorldState::initialize() {
             stats.stamina = stats.maxStamina();
         }
     }
-
-    initializePassable(entities, passable);
 }
 
 void WorldState::logInformation(const std::vector<std::wstring>& information) {
@@ -218,38 +575,255 @@ void WorldState::logEvent(WorldEvent event) {
     if (event.y >= this->field_height or event.x >= this->field_width) {
         throw std::runtime_error("Cannot log event at "+std::to_string(event.y)+", "+std::to_string(event.x)+": out of bounds.");
     }
-    events.push_back(event);
+    event.sequence = next_event_sequence++;
+    size_t region = (event.y / event_region_size) * event_regions_wide + event.x / event_region_size;
+    if (event_regions[region].empty()) {
+        active_event_regions.push_back(region);
+    }
+    event_regions[region].push_back(std::move(event));
 }
 
-std::vector<std::string> WorldState::getLocalEvents(size_t y, size_t x, size_t range) {
-    std::vector<std::string> local_events;
-    for (WorldEvent& event : events) {
-        if (abs(y - event.y) + abs(x - event.x) <= (int64_t)range) {
-            // Making this a coroutine is possible, but current feels more clunky than it is worth.
-            local_events.push_back(event.message);
+std::string WorldState::eventName(size_t entity_id) const {
+    if (const Entity* entity = entities.get(entities.find(entity_id))) {
+        return entity->name;
+    }
+    auto departed = departed_names.find(entity_id);
+    if (departed != departed_names.end()) {
+        return departed->second;
+    }
+    // Entities that were inserted this tick have not been placed into storage yet.
+    auto pending = std::find_if(pending_entities.begin(), pending_entities.end(),
+        [=](const Entity& entity) {return entity.entity_id == entity_id;});
+    if (pending != pending_entities.end()) {
+        return pending->name;
+    }
+    return "something";
+}
+
+void replacePlaceholder(std::string& str, const std::string& placeholder, const std::string& replacement) {
+    std::string::size_type index = str.find(placeholder);
+    if (index != std::string::npos) {
+        str.replace(index, placeholder.size(), replacement);
+    }
+}
+
+std::string WorldState::renderEvent(const WorldEvent& event, size_t observer_id) const {
+    if (EventType::tick == event.type) {
+        return "==========Tick " + std::to_string(event.tick) + "========";
+    }
+    std::string message;
+    if (EventType::drop == event.type) {
+        message = "<entity> drops <target>.";
+    }
+    else if (nullptr != event.flavor) {
+        message = *event.flavor;
+    }
+    if (std::string::npos != message.find("<entity>")) {
+        // Observers see their own actions in the second person.
+        replacePlaceholder(message, "<entity>", event.actor_id == observer_id ? "You" : eventName(event.actor_id));
+    }
+    if (std::string::npos != message.find("<target>")) {
+        replacePlaceholder(message, "<target>", 0 == event.target_id ? "something" : eventName(event.target_id));
+    }
+    if (not event.slot.empty()) {
+        replacePlaceholder(message, "<slot>", event.slot);
+    }
+    return message;
+}
+
+std::vector<std::string> WorldState::getLocalEvents(const Entity& observer, size_t range) const {
+    // Only visit the regions that overlap the square around the observer.
+    size_t first_row = (observer.y - std::min(observer.y, range)) / event_region_size;
+    size_t last_row = std::min(observer.y + range, field_height - 1) / event_region_size;
+    size_t first_col = (observer.x - std::min(observer.x, range)) / event_region_size;
+    size_t last_col = std::min(observer.x + range, field_width - 1) / event_region_size;
+
+    std::vector<const WorldEvent*> local_events;
+    for (size_t row = first_row; row <= last_row; ++row) {
+        for (size_t col = first_col; col <= last_col; ++col) {
+            for (const WorldEvent& event : event_regions[row * event_regions_wide + col]) {
+                if (OlymposUtility::manhattanDistance(observer.y, observer.x, event.y, event.x) <= range) {
+                    local_events.push_back(&event);
+                }
+            }
         }
     }
-    return local_events;
+    std::sort(local_events.begin(), local_events.end(),
+        [](const WorldEvent* a, const WorldEvent* b) {return a->sequence < b->sequence;});
+
+    // Text is only created for the events that this observer receives.
+    std::vector<std::string> messages;
+    messages.reserve(local_events.size());
+    for (const WorldEvent* event : local_events) {
+        messages.push_back(renderEvent(*event, observer.entity_id));
+    }
+    return messages;
 }
 
 void WorldState::clearEvents() {
-    events.clear();
+    for (size_t region : active_event_regions) {
+        event_regions[region].clear();
+    }
+    active_event_regions.clear();
+    departed_names.clear();
+}
+
+void WorldState::storeSuspended(size_t chunk, const json& records) {
+    std::vector<uint8_t> serialized = json::to_cbor(records);
+    if (suspend_directory.empty()) {
+        suspended_entities[chunk] = std::move(serialized);
+        return;
+    }
+    std::filesystem::create_directories(suspend_directory);
+    std::filesystem::path chunk_path = suspend_directory / ("chunk_" + std::to_string(chunk) + ".cbor");
+    std::ofstream ostream(chunk_path, std::ios::binary);
+    ostream.write(reinterpret_cast<const char*>(serialized.data()), serialized.size());
+    if (not ostream) {
+        throw std::runtime_error("Failed to write suspended chunk to " + chunk_path.string());
+    }
+}
+
+json WorldState::loadSuspended(size_t chunk) {
+    std::vector<uint8_t> serialized;
+    if (suspend_directory.empty()) {
+        auto stored = suspended_entities.find(chunk);
+        if (stored == suspended_entities.end()) {
+            return json::array();
+        }
+        serialized = std::move(stored->second);
+        suspended_entities.erase(stored);
+    }
+    else {
+        std::filesystem::path chunk_path = suspend_directory / ("chunk_" + std::to_string(chunk) + ".cbor");
+        if (not std::filesystem::exists(chunk_path)) {
+            return json::array();
+        }
+        {
+            std::ifstream istream(chunk_path, std::ios::binary);
+            serialized.assign(std::istreambuf_iterator<char>(istream), std::istreambuf_iterator<char>());
+        }
+        std::filesystem::remove(chunk_path);
+    }
+    return json::from_cbor(serialized);
+}
+
+void WorldState::suspendChunk(size_t chunk) {
+    json records = json::array();
+    // Removal edits the chunk's entity list, so work from a copy.
+    std::vector<EntityHandle> chunk_entities = chunks.find(chunk)->entities;
+    for (EntityHandle handle : chunk_entities) {
+        if (const Entity* entity = entities.get(handle)) {
+            records.push_back(serializeEntity(*entity));
+            removeEntity(handle);
+        }
+    }
+    storeSuspended(chunk, records);
+    chunks.release(chunk);
+    tile_effects.releaseChunk(chunk);
+    for (auto& [target, field] : flow_fields) {
+        field.second.releaseChunk(chunk);
+    }
+    suspended[chunk] = true;
+    suspended_count += 1;
+    terrain_version += 1;
+}
+
+void WorldState::resumeChunk(size_t chunk) {
+    suspended[chunk] = false;
+    suspended_count -= 1;
+    terrain_version += 1;
+    for (const json& record : loadSuspended(chunk)) {
+        pending_entities.push_back(deserializeEntity(record));
+    }
+}
+
+void WorldState::updateResidency() {
+    static const TraitId player_trait = Traits::intern("player");
+    // Chunk coordinates of every player.
+    std::vector<std::pair<size_t, size_t>> player_chunks;
+    for (EntityHandle handle : trait_index.entitiesWith(player_trait)) {
+        if (const Entity* entity = entities.get(handle)) {
+            size_t chunk = chunks.chunkOf(entity->y, entity->x);
+            player_chunks.push_back({chunk / chunks.chunksWide(), chunk % chunks.chunksWide()});
+        }
+    }
+    const size_t radius = active_chunk_radius.value();
+    auto near_player = [&](size_t chunk) {
+        size_t row = chunk / chunks.chunksWide();
+        size_t col = chunk % chunks.chunksWide();
+        return std::any_of(player_chunks.begin(), player_chunks.end(),
+            [=](const std::pair<size_t, size_t>& player) {
+                return std::max(row, player.first) - std::min(row, player.first) <= radius and
+                    std::max(col, player.second) - std::min(col, player.second) <= radius;
+            });
+    };
+
+    // Suspending and releasing edits the list of allocated chunks, so work from a copy.
+    std::vector<size_t> allocated = chunks.allocatedChunks();
+    for (size_t chunk : allocated) {
+        if (chunks.find(chunk)->entities.empty()) {
+            // Empty chunks have no blockers, so their storage can simply be freed.
+            chunks.release(chunk);
+        }
+        else if (not near_player(chunk)) {
+            suspendChunk(chunk);
+        }
+    }
+
+    if (0 < suspended_count) {
+        for (auto [player_row, player_col] : player_chunks) {
+            size_t first_row = player_row - std::min(player_row, radius);
+            size_t last_row = std::min(player_row + radius, chunks.chunksHigh() - 1);
+            size_t first_col = player_col - std::min(player_col, radius);
+            size_t last_col = std::min(player_col + radius, chunks.chunksWide() - 1);
+            for (size_t row = first_row; row <= last_row; ++row) {
+                for (size_t col = first_col; col <= last_col; ++col) {
+                    if (suspended[row * chunks.chunksWide() + col]) {
+                        resumeChunk(row * chunks.chunksWide() + col);
+                    }
+                }
+            }
+        }
+    }
 }
 
 void WorldState::update() {
     cur_tick += 1;
+    perception.clear();
+    random_streams.clear();
+    std::erase_if(flow_fields,
+        [&](const auto& field) {return field.second.first + flow_field_idle_ticks < cur_tick;});
+
+    if (active_chunk_radius) {
+        updateResidency();
+    }
+
+    // No commands are running, so entity storage can be rearranged.
+    entities.compact();
+    for (Entity& entity : pending_entities) {
+        size_t chunk = chunks.chunkOf(entity.y, entity.x);
+        if (suspended[chunk]) {
+            // The entity joins the other entities of its chunk until the chunk is resumed.
+            json records = loadSuspended(chunk);
+            records.push_back(serializeEntity(entity));
+            storeSuspended(chunk, records);
+        }
+        else {
+            indexEntity(entities.insert(std::move(entity)));
+        }
+    }
+    pending_entities.clear();
 
     // Need to handle events that occur every tick.
 
-    // Tic updates are independent per entity and can be done in parallel and in any order.
-    std::for_each(std::execution::par_unseq, entities.begin(), entities.end(),
-        [cur_tick=cur_tick](Entity& ent) {
-            if (ent.stats) {
-            ent.stats.value().ticHealthManaStamina(cur_tick);
-        }});
+    // Regeneration gains are computed for all entities at once and then applied to each entity.
+    regen_table.computeGains(cur_tick);
+    for (size_t row = 0; row < regen_table.size(); ++row) {
+        regen_table.apply(row, entities.at(regen_table.handle(row)).stats.value());
+    }
     // TODO FIXME The event queue should be handled a bit differently
-    auto player_i = findEntity(std::vector<std::string>{"player"});
-    if (player_i != entities.end()) {
-        logEvent({"==========Tick " + std::to_string(cur_tick) + "========", player_i->y, player_i->x});
+    Entity* player = entities.get(findEntity(std::vector<std::string>{"player"}));
+    if (nullptr != player) {
+        logEvent({.type = EventType::tick, .tick = cur_tick, .y = player->y, .x = player->x});
     }
 }